@@ -0,0 +1,123 @@
+// Microbenchmark of the LEB128 decoders.
+//
+// Decodes streams of LEBs with the fast decoders and with the LLVM
+// byte-at-a-time ones, checks that they agree and prints the time per
+// value. The "reloc" stream mimics a relocation section: a type byte, a
+// 5-byte padded offset, a small symbol index and sometimes an addend.
+//
+// Usage: bench_leb128 [number of values]
+
+#include "common/integers.h"
+#include "common/leb128.h"
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace xld;
+
+namespace {
+struct Stream {
+    const char *name;
+    std::vector<u8> buf;
+    i64 count = 0;
+    bool is_signed = false;
+};
+} // namespace
+
+static void add_uleb(Stream &s, u64 val, unsigned pad = 0) {
+    u8 tmp[16];
+    unsigned n = encode_uleb128(val, tmp, pad);
+    s.buf.insert(s.buf.end(), tmp, tmp + n);
+    s.count++;
+}
+
+static void add_sleb(Stream &s, i64 val) {
+    u8 tmp[16];
+    unsigned n = encode_sleb128(val, tmp);
+    s.buf.insert(s.buf.end(), tmp, tmp + n);
+    s.count++;
+}
+
+static std::vector<Stream> make_streams(i64 n) {
+    std::mt19937_64 rng(42);
+    std::vector<Stream> streams;
+
+    Stream small{"1-byte"};
+    for (i64 i = 0; i < n; i++)
+        add_uleb(small, rng() % 128);
+    streams.push_back(std::move(small));
+
+    Stream mixed{"mixed"};
+    for (i64 i = 0; i < n; i++)
+        add_uleb(mixed, rng() >> (rng() % 64));
+    streams.push_back(std::move(mixed));
+
+    Stream reloc{"reloc"};
+    for (i64 i = 0; i < n / 4; i++) {
+        add_uleb(reloc, rng() % 20);
+        add_uleb(reloc, rng() % (1 << 20), 5);
+        add_uleb(reloc, rng() % 1000);
+        add_uleb(reloc, (rng() % 4) ? 0 : rng() % 100);
+    }
+    streams.push_back(std::move(reloc));
+
+    Stream sleb{"signed"};
+    sleb.is_signed = true;
+    for (i64 i = 0; i < n; i++)
+        add_sleb(sleb, (i64)(rng() >> (rng() % 64)) - (i64)(rng() % 1000));
+    streams.push_back(std::move(sleb));
+    return streams;
+}
+
+template <typename F>
+static double measure(const Stream &s, F decode, u64 &sum) {
+    auto start = std::chrono::steady_clock::now();
+    const u8 *p = s.buf.data();
+    sum = 0;
+    for (i64 i = 0; i < s.count; i++)
+        sum = sum * 31 + decode(p);
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() /
+           s.count;
+}
+
+int main(int argc, char **argv) {
+    i64 n = (argc > 1) ? atoll(argv[1]) : 10'000'000;
+    int status = 0;
+
+    for (Stream &s : make_streams(n)) {
+        // Leave room for the word loads of the fast decoder, as a mapped
+        // file would.
+        s.buf.resize(s.buf.size() + 8);
+
+        u64 sum_llvm, sum_fast;
+        double llvm, fast;
+        if (s.is_signed) {
+            llvm = measure(s, [](const u8 *&p) -> u64 {
+                return decodeSLEB128AndInc(p);
+            }, sum_llvm);
+            fast = measure(s, [](const u8 *&p) -> u64 {
+                return decode_sleb128_fast(p);
+            }, sum_fast);
+        } else {
+            llvm = measure(s, [](const u8 *&p) -> u64 {
+                return decodeULEB128AndInc(p);
+            }, sum_llvm);
+            fast = measure(s, [](const u8 *&p) -> u64 {
+                return decode_uleb128_fast(p);
+            }, sum_fast);
+        }
+
+        std::cout << s.name << ": " << s.count << " values, llvm " << llvm
+                  << " ns/value, fast " << fast << " ns/value ("
+                  << llvm / fast << "x)\n";
+        if (sum_llvm != sum_fast) {
+            std::cout << s.name << ": decoded values differ\n";
+            status = 1;
+        }
+    }
+    return status;
+}
@@ -28,6 +28,7 @@
 #include "common/file.h"
 #include "common/filetype.h"
 #include "common/system.h"
+#include "oneapi/tbb/parallel_for.h"
 
 namespace xld {
 
@@ -75,12 +76,20 @@ struct ArHdr {
     }
 };
 
+// If `hdr_offsets` is not null, the offset of each member's header from the
+// beginning of the archive is appended to it. The archive symbol table
+// refers to members by these offsets.
+//
+// Members of a thin archive are separate files. Their paths are collected
+// first and then the files are opened in parallel, since a large library
+// may have thousands of them.
 template <typename Context>
-std::vector<MappedFile *> read_thin_archive_members(Context &ctx,
-                                                    MappedFile *mf) {
+std::vector<MappedFile *>
+read_thin_archive_members(Context &ctx, MappedFile *mf,
+                          std::vector<u64> *hdr_offsets = nullptr) {
     u8 *begin = mf->data;
     u8 *data = begin + 8;
-    std::vector<MappedFile *> vec;
+    std::vector<std::string> paths;
     std::string_view strtab;
 
     while (data < begin + mf->size) {
@@ -89,6 +98,7 @@ std::vector<MappedFile *> read_thin_archive_members(Context &ctx,
             data++;
 
         ArHdr &hdr = *(ArHdr *)data;
+        u64 hdr_offset = data - begin;
         u8 *body = data + sizeof(hdr);
         u64 size = atol(hdr.ar_size);
 
@@ -110,26 +120,33 @@ std::vector<MappedFile *> read_thin_archive_members(Context &ctx,
                        << ": filename is not stored as a long filename";
 
         std::string name = hdr.read_name(strtab, body);
-        Debug(ctx) << "member: " << name;
+        Debug(ctx, DEBUG_INPUT) << "member: " << name;
 
         // Skip if symbol table
         if (name == "__.SYMDEF" || name == "__.SYMDEF SORTED")
             continue;
 
-        std::string path =
-            name.starts_with('/')
-                ? name
-                : (filepath(mf->name).parent_path() / name).string();
-        vec.push_back(must_open_file(ctx, path));
-        vec.back()->thin_parent = mf;
+        if (name.starts_with('/'))
+            paths.push_back(name);
+        else
+            paths.push_back((filepath(mf->name).parent_path() / name).string());
+        if (hdr_offsets)
+            hdr_offsets->push_back(hdr_offset);
         data = body;
     }
+
+    std::vector<MappedFile *> vec(paths.size());
+    tbb::parallel_for((size_t)0, paths.size(), [&](size_t i) {
+        vec[i] = must_open_file(ctx, paths[i]);
+        vec[i]->thin_parent = mf;
+    });
     return vec;
 }
 
 template <typename Context>
-std::vector<MappedFile *> read_fat_archive_members(Context &ctx,
-                                                   MappedFile *mf) {
+std::vector<MappedFile *>
+read_fat_archive_members(Context &ctx, MappedFile *mf,
+                         std::vector<u64> *hdr_offsets = nullptr) {
     u8 *begin = mf->data;
     u8 *data = begin + 8;
     std::vector<MappedFile *> vec;
@@ -140,6 +157,7 @@ std::vector<MappedFile *> read_fat_archive_members(Context &ctx,
             data++;
 
         ArHdr &hdr = *(ArHdr *)data;
+        u64 hdr_offset = data - begin;
         u8 *body = data + sizeof(hdr);
         u64 size = atol(hdr.ar_size);
         data = body + size;
@@ -156,27 +174,83 @@ std::vector<MappedFile *> read_fat_archive_members(Context &ctx,
 
         // Read the name field
         std::string name = hdr.read_name(strtab, body);
-        Debug(ctx) << "member: " << name;
+        Debug(ctx, DEBUG_INPUT) << "member: " << name;
 
         // Skip if symbol table
         if (name == "__.SYMDEF" || name == "__.SYMDEF SORTED")
             continue;
 
         vec.push_back(mf->slice(ctx, name, body - begin, data - body));
+        if (hdr_offsets)
+            hdr_offsets->push_back(hdr_offset);
     }
     return vec;
 }
 
 template <typename Context>
-std::vector<MappedFile *> read_archive_members(Context &ctx, MappedFile *mf) {
+std::vector<MappedFile *>
+read_archive_members(Context &ctx, MappedFile *mf,
+                     std::vector<u64> *hdr_offsets = nullptr) {
     switch (get_file_type(ctx, mf)) {
     case FileType::AR:
-        return read_fat_archive_members(ctx, mf);
+        return read_fat_archive_members(ctx, mf, hdr_offsets);
     case FileType::THIN_AR:
-        return read_thin_archive_members(ctx, mf);
+        return read_thin_archive_members(ctx, mf, hdr_offsets);
     default:
         unreachable();
     }
 }
 
+// An entry of the archive symbol table: a defined symbol and the offset
+// of the header of the member which defines it.
+struct ArSymbol {
+    std::string_view name;
+    u64 hdr_offset;
+};
+
+// Reads the GNU-style archive symbol table ("/" or "/SYM64/"), which is
+// the first member of an archive if it exists. It consists of a
+// big-endian count, that many big-endian member offsets, and the same
+// number of NUL-terminated symbol names. Returns an empty vector if the
+// archive does not have a symbol table in this format.
+template <typename Context>
+std::vector<ArSymbol> read_archive_symtab(Context &ctx, MappedFile *mf) {
+    if (mf->size < 8 + (i64)sizeof(ArHdr))
+        return {};
+
+    ArHdr &hdr = *(ArHdr *)(mf->data + 8);
+    if (!hdr.is_symtab())
+        return {};
+
+    u8 *body = (u8 *)&hdr + sizeof(hdr);
+    u8 *end = body + atol(hdr.ar_size);
+    i64 word_size = hdr.starts_with("/SYM64/ ") ? 8 : 4;
+    if (end > mf->data + mf->size || end - body < word_size)
+        Fatal(ctx) << mf->name << ": corrupted archive symbol table";
+
+    auto read_word = [&](u8 *p) {
+        u64 val = 0;
+        for (i64 i = 0; i < word_size; i++)
+            val = (val << 8) | p[i];
+        return val;
+    };
+
+    u64 num = read_word(body);
+    u8 *offsets = body + word_size;
+    const char *strtab = (const char *)(offsets + num * word_size);
+    if ((u8 *)strtab > end)
+        Fatal(ctx) << mf->name << ": corrupted archive symbol table";
+
+    std::vector<ArSymbol> vec;
+    vec.reserve(num);
+    for (u64 i = 0; i < num; i++) {
+        size_t len = strnlen(strtab, (const char *)end - strtab);
+        if (strtab + len == (const char *)end)
+            Fatal(ctx) << mf->name << ": corrupted archive symbol table";
+        vec.push_back({{strtab, len}, read_word(offsets + i * word_size)});
+        strtab += len + 1;
+    }
+    return vec;
+}
+
 } // namespace xld
@@ -0,0 +1,188 @@
+// This file defines the archive index, a table which maps the names of
+// the symbols defined by the members of an archive to those members.
+//
+// A program usually needs only a few members of a large static library.
+// The index lists the symbols sorted by the hash of their names, so
+// finding the member which defines a symbol is a binary search, and
+// nothing has to be done for the members that are not needed. It also
+// records the offset and size of every member, so a member can be sliced
+// out of the archive without walking the member headers.
+//
+// An index is a flat, position-independent buffer which can be used
+// directly from a mapped file: a header, the member table, the symbol
+// table and a string table. It records the size and modification time
+// of its archive and is ignored once they change.
+
+#pragma once
+
+#include "common/integers.h"
+#include "common/mmap.h"
+#include "common/system.h"
+#include <algorithm>
+#include <cstring>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace xld {
+
+constexpr char kArchiveIndexMagic[8] = {'X', 'L', 'D', 'A',
+                                        'R', 'I', 'D', 'X'};
+constexpr u32 kArchiveIndexVersion = 2;
+// Suffix of the index file which `xld --index-archive` writes next to an
+// archive
+constexpr std::string_view kArchiveIndexSuffix = ".xldidx";
+
+struct ArchiveIndexHeader {
+    char magic[8];
+    u32 version;
+    u32 num_members;
+    u32 num_symbols;
+    u32 strtab_size;
+    u64 archive_size;
+    i64 archive_mtime;
+};
+
+struct ArchiveIndexMember {
+    // Offset of the member header from the beginning of the archive
+    u64 hdr_offset;
+    // Offset and size of the member contents in the archive
+    u64 offset;
+    u64 size;
+    // Member name in the string table
+    u32 name_offset;
+    u32 name_size;
+};
+
+struct ArchiveIndexSymbol {
+    u64 hash;
+    // Index of the defining member in the member table
+    u32 member;
+    // Symbol name in the string table
+    u32 name_offset;
+    u32 name_size;
+    // Always zero
+    u32 reserved;
+};
+
+static_assert(sizeof(ArchiveIndexHeader) % 8 == 0);
+static_assert(sizeof(ArchiveIndexMember) % 8 == 0);
+static_assert(sizeof(ArchiveIndexSymbol) % 8 == 0);
+
+// A read-only view of an index
+class ArchiveIndex {
+  public:
+    // Points this view to `data`. Returns false if `data` is not an index
+    // of `archive` in its current state.
+    bool open(std::span<const u8> data, MappedFile *archive) {
+        if (data.size() < sizeof(ArchiveIndexHeader))
+            return false;
+
+        ArchiveIndexHeader hdr;
+        memcpy(&hdr, data.data(), sizeof(hdr));
+        if (memcmp(hdr.magic, kArchiveIndexMagic, sizeof(hdr.magic)) ||
+            hdr.version != kArchiveIndexVersion ||
+            hdr.archive_size != (u64)archive->size ||
+            hdr.archive_mtime != archive->mtime)
+            return false;
+
+        u64 size = sizeof(hdr) +
+                   (u64)hdr.num_members * sizeof(ArchiveIndexMember) +
+                   (u64)hdr.num_symbols * sizeof(ArchiveIndexSymbol) +
+                   hdr.strtab_size;
+        if (size != data.size())
+            return false;
+
+        const u8 *p = data.data() + sizeof(hdr);
+        members = {(const ArchiveIndexMember *)p, hdr.num_members};
+        p += hdr.num_members * sizeof(ArchiveIndexMember);
+        symbols = {(const ArchiveIndexSymbol *)p, hdr.num_symbols};
+        p += hdr.num_symbols * sizeof(ArchiveIndexSymbol);
+        strtab = {(const char *)p, hdr.strtab_size};
+        return true;
+    }
+
+    // Returns an empty string if the range is out of the string table.
+    std::string_view get_string(u32 offset, u32 size) const {
+        if ((u64)offset + size > strtab.size())
+            return {};
+        return strtab.substr(offset, size);
+    }
+
+    // Returns the index of the first member which defines `name`, or -1.
+    i64 find(std::string_view name, u64 hash) const {
+        auto it = std::partition_point(
+            symbols.begin(), symbols.end(),
+            [&](const ArchiveIndexSymbol &sym) { return sym.hash < hash; });
+        for (; it != symbols.end() && it->hash == hash; it++)
+            if (it->member < members.size() &&
+                get_string(it->name_offset, it->name_size) == name)
+                return it->member;
+        return -1;
+    }
+
+    std::span<const ArchiveIndexMember> members;
+    std::span<const ArchiveIndexSymbol> symbols;
+    std::string_view strtab;
+};
+
+// A member and the symbols it defines, given to build_archive_index().
+struct ArchiveIndexInput {
+    std::string_view name;
+    u64 hdr_offset = 0;
+    u64 offset = 0;
+    u64 size = 0;
+    std::vector<std::string_view> symbols;
+};
+
+// Serializes an index of `archive`, whose members are `inputs` in
+// archive order. If several members define the same name, the first one
+// is found by ArchiveIndex::find().
+inline std::vector<u8>
+build_archive_index(MappedFile *archive,
+                    const std::vector<ArchiveIndexInput> &inputs) {
+    std::vector<ArchiveIndexMember> members;
+    std::vector<ArchiveIndexSymbol> symbols;
+    std::string strtab;
+
+    for (u32 i = 0; i < inputs.size(); i++) {
+        const ArchiveIndexInput &in = inputs[i];
+        members.push_back({in.hdr_offset, in.offset, in.size,
+                           (u32)strtab.size(), (u32)in.name.size()});
+        strtab += in.name;
+
+        for (std::string_view name : in.symbols) {
+            symbols.push_back({hash_string(name), i, (u32)strtab.size(),
+                               (u32)name.size(), 0});
+            strtab += name;
+        }
+    }
+
+    std::stable_sort(
+        symbols.begin(), symbols.end(),
+        [](const ArchiveIndexSymbol &a, const ArchiveIndexSymbol &b) {
+            return a.hash < b.hash;
+        });
+
+    ArchiveIndexHeader hdr;
+    memcpy(hdr.magic, kArchiveIndexMagic, sizeof(hdr.magic));
+    hdr.version = kArchiveIndexVersion;
+    hdr.num_members = members.size();
+    hdr.num_symbols = symbols.size();
+    hdr.strtab_size = strtab.size();
+    hdr.archive_size = archive->size;
+    hdr.archive_mtime = archive->mtime;
+
+    std::vector<u8> buf;
+    auto append = [&](const void *data, size_t size) {
+        buf.insert(buf.end(), (const u8 *)data, (const u8 *)data + size);
+    };
+    append(&hdr, sizeof(hdr));
+    append(members.data(), members.size() * sizeof(members[0]));
+    append(symbols.data(), symbols.size() * sizeof(symbols[0]));
+    append(strtab.data(), strtab.size());
+    return buf;
+}
+
+} // namespace xld
@@ -0,0 +1,100 @@
+// This file defines Arena, a bump-pointer allocator for objects that live
+// as long as their owner, such as the input fragments of an object file.
+//
+// Objects are carved out of large blocks, so creating one is a pointer
+// increment instead of a malloc call, and objects created one after
+// another are adjacent in memory. They cannot be freed individually.
+// When the arena is destroyed, destructors of the objects that need one
+// run in reverse order of creation and then the blocks are freed at once.
+//
+// An arena is not thread-safe. Give each thread or each file its own.
+
+#pragma once
+
+#include "common/integers.h"
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace xld {
+
+class Arena {
+  public:
+    Arena() = default;
+    Arena(const Arena &) = delete;
+
+    ~Arena() {
+        for (auto it = dtors.rbegin(); it != dtors.rend(); it++)
+            it->second(it->first);
+        for (u8 *block : blocks)
+            free(block);
+    }
+
+    // Constructs a T in the arena.
+    template <typename T, typename... Args>
+    T *create(Args &&...args) {
+        T *obj = new (allocate(sizeof(T), alignof(T)))
+            T(std::forward<Args>(args)...);
+        if constexpr (!std::is_trivially_destructible_v<T>)
+            dtors.push_back({obj, [](void *p) { ((T *)p)->~T(); }});
+        return obj;
+    }
+
+    // Returns uninitialized storage for `n` objects of type T, which the
+    // caller constructs, possibly from many threads. No destructors are
+    // run for them.
+    template <typename T>
+    T *allocate_array(i64 n) {
+        static_assert(std::is_trivially_destructible_v<T>);
+        return (T *)allocate(n * sizeof(T), alignof(T));
+    }
+
+    // Makes sure that the next `n` objects of type T come from a single
+    // block. Call this before creating a batch of objects to lay them out
+    // contiguously.
+    template <typename T>
+    void reserve(i64 n) {
+        i64 nbytes = n * sizeof(T) + alignof(T);
+        if (end - cur < nbytes)
+            new_block(nbytes);
+    }
+
+  private:
+    static constexpr i64 MIN_BLOCK_SIZE = 4096;
+    static constexpr i64 MAX_BLOCK_SIZE = 1024 * 1024;
+
+    void *allocate(i64 size, i64 align) {
+        u8 *p = (u8 *)(((uintptr_t)cur + align - 1) & ~(uintptr_t)(align - 1));
+        if (p + size > end) {
+            new_block(size + align);
+            p = (u8 *)(((uintptr_t)cur + align - 1) & ~(uintptr_t)(align - 1));
+        }
+        cur = p + size;
+        return p;
+    }
+
+    // Blocks grow geometrically so that a small file does not waste
+    // memory and a large one does not need many blocks.
+    void new_block(i64 min_size) {
+        block_size = std::min(block_size * 2, MAX_BLOCK_SIZE);
+        i64 size = std::max(block_size, min_size);
+        u8 *block = (u8 *)malloc(size);
+        if (!block)
+            throw std::bad_alloc();
+        blocks.push_back(block);
+        cur = block;
+        end = block + size;
+    }
+
+    u8 *cur = nullptr;
+    u8 *end = nullptr;
+    i64 block_size = MIN_BLOCK_SIZE / 2;
+    std::vector<u8 *> blocks;
+    std::vector<std::pair<void *, void (*)(void *)>> dtors;
+};
+
+} // namespace xld
@@ -10,6 +10,10 @@ namespace xld {
 
 inline char *output_tmpfile;
 
+// Thrown by Fatal and checkpoints instead of exiting the process if the
+// context's `throw_on_fatal` is set
+struct FatalError {};
+
 std::string errno_string();
 
 template <typename Context>
@@ -24,6 +28,7 @@ std::string_view save_string(Context &ctx, const std::string &str) {
 inline void cleanup() {
     if (output_tmpfile)
         unlink(output_tmpfile);
+    output_tmpfile = nullptr;
 }
 
 inline i64 get_default_thread_count() {
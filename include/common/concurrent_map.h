@@ -0,0 +1,255 @@
+// This file defines ConcurrentMap, an insert-only hash map from strings
+// to values which many threads can insert into at once without taking a
+// lock. It is used as the global symbol table.
+//
+// The map is split into shards selected by the high bits of a key's hash.
+// Each shard is a chain of open-addressing tables; a key is looked up by
+// probing a short window of slots, starting at its low hash bits, in
+// each table of the chain in turn. When a window is full, the key goes
+// to the next table, which is twice as large and is allocated on demand.
+// Since slots are only ever filled and never emptied, every thread
+// probing for the same key visits the same slots in the same order, so
+// two threads inserting the same key always meet at the same slot.
+//
+// A slot is claimed by a compare-and-swap on its key pointer. The winner
+// constructs the value in place and then publishes the key; a thread
+// that finds a claimed but not yet published slot spins until the key
+// becomes visible. This is the only waiting in the map, and it lasts for
+// the duration of one constructor call.
+//
+// Keys are not copied. The memory they refer to must outlive the map.
+
+#pragma once
+
+#include "common/integers.h"
+#include "common/system.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string_view>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace xld {
+
+template <typename T>
+class ConcurrentMap {
+  public:
+    struct Stats {
+        u64 num_entries = 0;
+        u64 capacity = 0;
+        u64 num_tables = 0;
+        u64 total_probes = 0;
+        u64 max_probe = 0;
+        // Number of times a thread lost a race to claim an empty slot.
+        u64 num_cas_failures = 0;
+        // Number of times a thread had to wait for a slot being filled
+        // by another thread.
+        u64 num_waits = 0;
+    };
+
+    ConcurrentMap() = default;
+    ConcurrentMap(const ConcurrentMap &) = delete;
+
+    ~ConcurrentMap() {
+        for (std::atomic<Table *> &shard : shards) {
+            Table *t = shard.load(std::memory_order_relaxed);
+            while (t) {
+                Table *next = t->next.load(std::memory_order_relaxed);
+                free_table(t);
+                t = next;
+            }
+        }
+    }
+
+    // Sets the expected number of keys. The first table of each shard is
+    // sized accordingly. This has no effect on shards which already
+    // contain keys, so call this before inserting anything.
+    void reserve(i64 nkeys) {
+        i64 n = nkeys * 2 / NUM_SHARDS;
+        initial_nbuckets = std::max<i64>(MIN_NBUCKETS, std::bit_ceil((u64)n));
+    }
+
+    // Returns the value for `key`, constructing it from `args` if it does
+    // not exist yet. The second member of the result is true if the value
+    // was constructed by this call.
+    template <typename... Args>
+    std::pair<T *, bool> insert(std::string_view key, u64 hash,
+                                Args &&...args) {
+        const char *keyp = key.data() ? key.data() : "";
+        std::atomic<Table *> *link = &shards[hash >> SHARD_SHIFT];
+        i64 nbuckets = initial_nbuckets;
+
+        for (;;) {
+            Table *t = get_or_create_table(*link, nbuckets);
+            u64 mask = t->nbuckets - 1;
+
+            for (i64 i = 0; i < MAX_PROBE; i++) {
+                Entry &ent = t->entries[(hash + i) & mask];
+                const char *ptr = ent.key.load(std::memory_order_acquire);
+
+                if (!ptr) {
+                    if (ent.key.compare_exchange_strong(
+                            ptr, marker, std::memory_order_acquire)) {
+                        new (&ent.value) T(std::forward<Args>(args)...);
+                        ent.hash = hash;
+                        ent.keylen = key.size();
+                        ent.key.store(keyp, std::memory_order_release);
+                        return {&ent.value, true};
+                    }
+                    num_cas_failures.fetch_add(1, std::memory_order_relaxed);
+                }
+
+                if (ptr == marker) {
+                    num_waits.fetch_add(1, std::memory_order_relaxed);
+                    do {
+                        pause();
+                        ptr = ent.key.load(std::memory_order_acquire);
+                    } while (ptr == marker);
+                }
+
+                if (ent.hash == hash &&
+                    std::string_view(ptr, ent.keylen) == key)
+                    return {&ent.value, false};
+            }
+
+            link = &t->next;
+            nbuckets = t->nbuckets * 2;
+        }
+    }
+
+    // Returns the value for `key`, or nullptr if it does not exist.
+    T *find(std::string_view key, u64 hash) {
+        Table *t = shards[hash >> SHARD_SHIFT].load(std::memory_order_acquire);
+        for (; t; t = t->next.load(std::memory_order_acquire)) {
+            u64 mask = t->nbuckets - 1;
+            for (i64 i = 0; i < MAX_PROBE; i++) {
+                Entry &ent = t->entries[(hash + i) & mask];
+                const char *ptr = ent.key.load(std::memory_order_acquire);
+                if (!ptr)
+                    return nullptr;
+                while (ptr == marker) {
+                    pause();
+                    ptr = ent.key.load(std::memory_order_acquire);
+                }
+                if (ent.hash == hash &&
+                    std::string_view(ptr, ent.keylen) == key)
+                    return &ent.value;
+            }
+        }
+        return nullptr;
+    }
+
+    // Calls `fn` for each value in parallel. Must not run concurrently
+    // with insert().
+    template <typename F>
+    void for_each(F fn) {
+        tbb::parallel_for((i64)0, NUM_SHARDS, [&](i64 i) {
+            Table *t = shards[i].load(std::memory_order_acquire);
+            for (; t; t = t->next.load(std::memory_order_acquire))
+                for (i64 j = 0; j < t->nbuckets; j++)
+                    if (t->entries[j].key.load(std::memory_order_acquire))
+                        fn(t->entries[j].value);
+        });
+    }
+
+    // Scans the whole map, so this is only for diagnostics.
+    Stats get_stats() {
+        Stats stats;
+        for (std::atomic<Table *> &shard : shards) {
+            Table *t = shard.load(std::memory_order_acquire);
+            for (; t; t = t->next.load(std::memory_order_acquire)) {
+                stats.num_tables++;
+                stats.capacity += t->nbuckets;
+                u64 mask = t->nbuckets - 1;
+                for (i64 j = 0; j < t->nbuckets; j++) {
+                    Entry &ent = t->entries[j];
+                    if (!ent.key.load(std::memory_order_acquire))
+                        continue;
+                    u64 probe = ((u64)j - ent.hash) & mask;
+                    stats.num_entries++;
+                    stats.total_probes += probe + 1;
+                    stats.max_probe = std::max(stats.max_probe, probe + 1);
+                }
+            }
+        }
+        stats.num_cas_failures = num_cas_failures;
+        stats.num_waits = num_waits;
+        return stats;
+    }
+
+  private:
+    static constexpr i64 SHARD_BITS = 6;
+    static constexpr i64 NUM_SHARDS = 1 << SHARD_BITS;
+    static constexpr i64 SHARD_SHIFT = 64 - SHARD_BITS;
+    static constexpr i64 MIN_NBUCKETS = 64;
+    static constexpr i64 MAX_PROBE = 32;
+
+    struct Entry {
+        Entry() = delete;
+        ~Entry() = delete;
+
+        std::atomic<const char *> key;
+        u64 hash;
+        u32 keylen;
+        union {
+            T value;
+        };
+    };
+
+    struct Table {
+        Entry *entries;
+        i64 nbuckets;
+        std::atomic<Table *> next;
+    };
+
+    static inline const char *marker = "marker";
+
+    static void pause() {
+#if defined(__x86_64__) || defined(__i386__)
+        _mm_pause();
+#endif
+    }
+
+    // Entries are zero-initialized, which is how an empty slot looks, so
+    // a large table costs nothing until its pages are touched.
+    static Table *get_or_create_table(std::atomic<Table *> &link,
+                                      i64 nbuckets) {
+        Table *t = link.load(std::memory_order_acquire);
+        if (t)
+            return t;
+
+        Table *t2 = new Table;
+        t2->entries = (Entry *)calloc(nbuckets, sizeof(Entry));
+        if (!t2->entries)
+            throw std::bad_alloc();
+        t2->nbuckets = nbuckets;
+        t2->next = nullptr;
+
+        if (link.compare_exchange_strong(t, t2, std::memory_order_acq_rel))
+            return t2;
+        free(t2->entries);
+        delete t2;
+        return t;
+    }
+
+    static void free_table(Table *t) {
+        if constexpr (!std::is_trivially_destructible_v<T>)
+            for (i64 i = 0; i < t->nbuckets; i++)
+                if (t->entries[i].key.load(std::memory_order_relaxed))
+                    t->entries[i].value.~T();
+        free(t->entries);
+        delete t;
+    }
+
+    std::atomic<Table *> shards[NUM_SHARDS] = {};
+    i64 initial_nbuckets = MIN_NBUCKETS;
+
+    std::atomic<u64> num_cas_failures = 0;
+    std::atomic<u64> num_waits = 0;
+};
+
+} // namespace xld
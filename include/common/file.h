@@ -3,12 +3,21 @@
 #include "common/log.h"
 #include "common/mmap.h"
 #include <filesystem>
+#include <span>
 #include <sys/stat.h>
 
 namespace xld {
 
 MappedFile *open_file_impl(const std::string &path, std::string &error);
 
+// Returns the modification time of a file in nanoseconds.
+i64 get_mtime(const struct stat &st);
+
+// Writes `data` to a temporary file and renames it to `path`, so that
+// concurrent readers never see a partially written file. Returns false
+// and leaves errno set on failure.
+bool write_file_atomic(const std::string &path, std::span<const u8> data);
+
 template <typename T>
 std::filesystem::path filepath(const T &path) {
     return {path, std::filesystem::path::format::generic_format};
@@ -22,8 +22,14 @@
 #endif
 
 #include "common/integers.h"
+#include <bit>
+#include <cstring>
 #include <ostream>
 
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
 namespace xld {
 
 /// Utility function to encode a SLEB128 value to an output stream. Returns
@@ -221,6 +227,102 @@ inline int64_t decodeSLEB128AndInc(const uint8_t *&p) {
     return ret;
 }
 
+// Fast LEB128 decoders for the parser.
+//
+// Most LEBs in an object file are indices and sizes which fit in one or
+// two bytes, so those are decoded without a loop. Longer ones, such as
+// the 5-byte padded LEBs that relocations point to, are decoded from a
+// single 8-byte load: the position of the first byte with a clear high
+// bit gives the length, and the 7-bit groups are then packed together
+// with PEXT if available or with three shift-and-mask steps otherwise.
+// LEBs longer than 8 bytes fall back to the loops above.
+//
+// The 8-byte load may read past the end of the encoded value. It is only
+// done if it stays within the page of the first byte, which is mapped
+// since that byte is, so the decoders never fault near the end of a
+// mapping. Bytes past the end of the input are still read, though, so
+// these are excluded from AddressSanitizer checks.
+
+namespace leb128_detail {
+
+// True if 8 bytes can be loaded from `p` without crossing a page
+// boundary. 4 KiB is the smallest page size of any supported target.
+inline bool can_load_word(const uint8_t *p) {
+    return ((uintptr_t)p & 4095) <= 4096 - 8;
+}
+
+// Decodes the LEB at `p` from one word. Returns its length in bytes, or
+// 0 if it is longer than 8 bytes.
+__attribute__((no_sanitize("address"))) inline unsigned
+decode_word(const uint8_t *p, uint64_t &value) {
+    uint64_t word;
+    memcpy(&word, p, 8);
+    uint64_t last = ~word & 0x8080808080808080;
+    if (last == 0)
+        return 0;
+
+    unsigned len = std::countr_zero(last) / 8 + 1;
+    if (len < 8)
+        word &= (1ULL << (len * 8)) - 1;
+
+#ifdef __BMI2__
+    value = _pext_u64(word, 0x7f7f7f7f7f7f7f7f);
+#else
+    word &= 0x7f7f7f7f7f7f7f7f;
+    word = (word & 0x007f007f007f007f) | ((word & 0x7f007f007f007f00) >> 1);
+    word = (word & 0x00003fff00003fff) | ((word & 0x3fff00003fff0000) >> 2);
+    word = (word & 0x000000000fffffff) | ((word & 0x0fffffff00000000) >> 4);
+    value = word;
+#endif
+    return len;
+}
+
+} // namespace leb128_detail
+
+inline uint64_t decode_uleb128_fast(const uint8_t *&p) {
+    uint8_t b0 = p[0];
+    if (LLVM_LIKELY(b0 < 0x80)) {
+        p += 1;
+        return b0;
+    }
+    uint8_t b1 = p[1];
+    if (b1 < 0x80) {
+        p += 2;
+        return (b0 & 0x7f) | ((uint64_t)b1 << 7);
+    }
+
+    uint64_t value;
+    if (leb128_detail::can_load_word(p))
+        if (unsigned len = leb128_detail::decode_word(p, value)) {
+            p += len;
+            return value;
+        }
+    return decodeULEB128AndInc(p);
+}
+
+inline int64_t decode_sleb128_fast(const uint8_t *&p) {
+    uint8_t b0 = p[0];
+    if (LLVM_LIKELY(b0 < 0x80)) {
+        p += 1;
+        return (int64_t)((uint64_t)b0 << 57) >> 57;
+    }
+    uint8_t b1 = p[1];
+    if (b1 < 0x80) {
+        p += 2;
+        uint64_t v = (b0 & 0x7f) | ((uint64_t)b1 << 7);
+        return (int64_t)(v << 50) >> 50;
+    }
+
+    uint64_t value;
+    if (leb128_detail::can_load_word(p))
+        if (unsigned len = leb128_detail::decode_word(p, value)) {
+            p += len;
+            unsigned shift = 64 - len * 7;
+            return (int64_t)(value << shift) >> shift;
+        }
+    return decodeSLEB128AndInc(p);
+}
+
 /// Utility function to get the size of the ULEB128-encoded value.
 unsigned get_uleb128_size(uint64_t Value);
 
@@ -1,8 +1,10 @@
 #pragma once
 
 #include "common/common.h"
+#include "common/integers.h"
 #include <iostream>
 #include <mutex>
+#include <optional>
 #include <sstream>
 
 namespace xld {
@@ -33,30 +35,54 @@ class SyncOut {
     std::stringstream ss;
 };
 
+// Subsystems whose debug messages can be enabled with --debug=<list>.
+enum DebugKind : u32 {
+    DEBUG_INPUT = 1 << 0,
+    DEBUG_SYMBOL = 1 << 1,
+    DEBUG_LAYOUT = 1 << 2,
+    DEBUG_RELOC = 1 << 3,
+    DEBUG_OUTPUT = 1 << 4,
+    DEBUG_ALL = ~0u,
+};
+
+// Debug messages are compiled out of release builds. The check is done
+// before the stream is created, so a disabled Debug formats nothing and
+// takes no lock.
+template <typename Context>
+inline bool is_debug_enabled(Context &ctx, u32 kind) {
+#ifdef NDEBUG
+    return false;
+#else
+    return ctx.arg.debug & kind;
+#endif
+}
+
 template <typename Context>
 class Debug {
   public:
-    Debug(Context &ctx, std::ostream *out = &std::cout) : out(out) {}
+    Debug(Context &ctx, u32 kind) {
+        if (is_debug_enabled(ctx, kind))
+            ss.emplace();
+    }
 
     ~Debug() {
-        if (out) {
+        if (ss) {
             std::scoped_lock lock(mu);
-            *out << "xld: \033[0;1;34mdebug\033[0m: " << ss.str() << "\n";
+            std::cout << "xld: \033[0;1;34mdebug\033[0m: " << ss->str() << "\n";
         }
     }
 
     template <class T>
     Debug &operator<<(T &&val) {
-        if (out)
-            ss << std::forward<T>(val);
+        if (ss)
+            *ss << std::forward<T>(val);
         return *this;
     }
 
     static inline std::mutex mu;
 
   private:
-    std::ostream *out;
-    std::stringstream ss;
+    std::optional<std::stringstream> ss;
 };
 
 template <typename Context>
@@ -66,62 +92,74 @@ static std::string add_color(Context &ctx, std::string msg) {
     return "xld: " + msg + ": ";
 }
 
+// Prints a warning or an error, or passes it to the diagnostic handler
+// of the context if it has one.
+template <typename Context>
+void report(Context &ctx, std::string kind, bool is_error, std::string msg) {
+    if (ctx.diagnostic_handler)
+        ctx.diagnostic_handler(is_error, std::move(msg));
+    else
+        SyncOut(ctx, &std::cerr) << add_color(ctx, kind) << msg;
+}
+
 template <typename Context>
 class Fatal {
   public:
-    Fatal(Context &ctx) : out(ctx, &std::cerr) {
-        out << add_color(ctx, "fatal");
-    }
+    Fatal(Context &ctx) : ctx(ctx) {}
 
-    [[noreturn]] ~Fatal() {
-        out.~SyncOut();
+    [[noreturn]] ~Fatal() noexcept(false) {
+        report(ctx, "fatal", true, ss.str());
         cleanup();
+        if (ctx.throw_on_fatal)
+            throw FatalError();
         _exit(1);
     }
 
     template <class T>
     Fatal &operator<<(T &&val) {
-        out << std::forward<T>(val);
+        ss << std::forward<T>(val);
         return *this;
     }
 
   private:
-    SyncOut<Context> out;
+    Context &ctx;
+    std::stringstream ss;
 };
 
 template <typename Context>
 class Error {
   public:
-    Error(Context &ctx) : out(ctx, &std::cerr) {
-        out << add_color(ctx, "error");
-        ctx.has_error = true;
-    }
+    Error(Context &ctx) : ctx(ctx) { ctx.has_error = true; }
+
+    ~Error() { report(ctx, "error", true, ss.str()); }
 
     template <class T>
     Error &operator<<(T &&val) {
-        out << std::forward<T>(val);
+        ss << std::forward<T>(val);
         return *this;
     }
 
   private:
-    SyncOut<Context> out;
+    Context &ctx;
+    std::stringstream ss;
 };
 
 template <typename Context>
 class Warn {
   public:
-    Warn(Context &ctx) : out(ctx, &std::cerr) {
-        out << add_color(ctx, "warning");
-    }
+    Warn(Context &ctx) : ctx(ctx) {}
+
+    ~Warn() { report(ctx, "warning", false, ss.str()); }
 
     template <class T>
     Warn &operator<<(T &&val) {
-        out << std::forward<T>(val);
+        ss << std::forward<T>(val);
         return *this;
     }
 
   private:
-    SyncOut<Context> out;
+    Context &ctx;
+    std::stringstream ss;
 };
 
 } // namespace xld
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include "common/integers.h"
 #include <memory>
+#include <span>
 #include <string>
 #include <sys/mman.h>
 
@@ -11,7 +12,7 @@ class MappedFile {
   public:
     ~MappedFile() { unmap(); }
     void unmap() {
-        if (size == 0 || !data)
+        if (size == 0 || !data || parent || is_borrowed)
             return;
 
         munmap(data, size);
@@ -24,6 +25,23 @@ class MappedFile {
         mf->name = name;
         mf->data = data + start;
         mf->size = size;
+        mf->mtime = mtime;
+        mf->parent = this;
+
+        ctx.mf_pool.push_back(std::unique_ptr<MappedFile>(mf));
+        return mf;
+    }
+
+    // Wraps memory owned by the caller, which must stay valid while the
+    // file is in use. The file is never written to.
+    template <typename Context>
+    static MappedFile *wrap(Context &ctx, std::string name,
+                            std::span<const u8> data) {
+        MappedFile *mf = new MappedFile;
+        mf->name = name;
+        mf->data = (u8 *)data.data();
+        mf->size = data.size();
+        mf->is_borrowed = true;
 
         ctx.mf_pool.push_back(std::unique_ptr<MappedFile>(mf));
         return mf;
@@ -36,7 +54,14 @@ class MappedFile {
     std::string name;
     u8 *data = nullptr;
     i64 size = 0;
+    // Modification time in nanoseconds. Slices inherit the time of the
+    // file they are cut out of.
+    i64 mtime = 0;
 
+    // The file a slice is cut out of. Slices do not own their mapping.
+    MappedFile *parent = nullptr;
+    // True if `data` is owned by the caller of wrap()
+    bool is_borrowed = false;
     MappedFile *thin_parent = nullptr;
 
     int fd = -1;
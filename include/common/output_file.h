@@ -81,8 +81,13 @@ class MemoryMappedOutputFile : public OutputFile<Context> {
     MemoryMappedOutputFile(Context &ctx, std::string path, i64 filesize,
                            i64 perm)
         : OutputFile<Context>(path, filesize, true) {
-        std::tie(this->fd, output_tmpfile) =
+        std::tie(this->fd, tmpfile) =
             open_or_create_file(ctx, path, filesize, perm);
+        // cleanup() removes the file if the process exits on an error.
+        // Links which throw errors instead may run concurrently, so this
+        // file is removed by the destructor for them.
+        if (!ctx.throw_on_fatal)
+            output_tmpfile = tmpfile;
 
         this->buf = (u8 *)mmap(nullptr, filesize, PROT_READ | PROT_WRITE,
                                MAP_SHARED, this->fd, 0);
@@ -94,6 +99,13 @@ class MemoryMappedOutputFile : public OutputFile<Context> {
     }
 
     ~MemoryMappedOutputFile() {
+        // Not closed if the link failed and the process keeps running
+        if (this->fd != -1) {
+            if (!this->is_unmapped)
+                munmap(this->buf, this->filesize);
+            ::close(this->fd);
+            unlink(tmpfile);
+        }
         if (fd2 != -1)
             ::close(fd2);
     }
@@ -110,6 +122,7 @@ class MemoryMappedOutputFile : public OutputFile<Context> {
             fwrite(&this->buf2[0], this->buf2.size(), 1, out);
             fclose(out);
         }
+        this->fd = -1;
 
         // If an output file already exists, open a file and then remove it.
         // This is the fastest way to unlink a file, as it does not make the
@@ -118,12 +131,14 @@ class MemoryMappedOutputFile : public OutputFile<Context> {
         if (fd2 != -1)
             unlink(this->path.c_str());
 
-        if (rename(output_tmpfile, this->path.c_str()) == -1)
+        if (rename(tmpfile, this->path.c_str()) == -1)
             Fatal(ctx) << this->path << ": rename failed: " << errno_string();
-        output_tmpfile = nullptr;
+        if (!ctx.throw_on_fatal)
+            output_tmpfile = nullptr;
     }
 
   private:
+    char *tmpfile = nullptr;
     int fd2 = -1;
 };
 
@@ -60,10 +60,45 @@ inline static int32_t align(int32_t offset, int32_t align) {
     return ((offset + align - 1) / align) * align;
 }
 
-// TODO: Use xxHash
-/*
+// Atomically lowers `atom` to `val` if `val` is smaller.
+template <typename T>
+inline void update_minimum(std::atomic<T> &atom, T val) {
+    T cur = atom.load(std::memory_order_relaxed);
+    while (val < cur && !atom.compare_exchange_weak(cur, val))
+        ;
+}
+
+// A 64-bit string hash used by the symbol table. xxHash is not vendored,
+// so this mixes the input a word at a time and finishes with the
+// MurmurHash3 avalanche. It is not meant to be cryptographically strong,
+// but its low and high bits are both well distributed, which matters
+// because ConcurrentMap shards by the high bits and probes with the low
+// bits.
 inline uint64_t hash_string(std::string_view str) {
-    return XXH3_64bits(str.data(), str.size());
+    const uint64_t k = 0x9e3779b97f4a7c15;
+    const char *p = str.data();
+    size_t n = str.size();
+    uint64_t h = n * k;
+
+    for (; n >= 8; p += 8, n -= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        h = (h ^ w) * k;
+        h ^= h >> 32;
+    }
+    if (n) {
+        uint64_t w = 0;
+        memcpy(&w, p, n);
+        h = (h ^ w) * k;
+        h ^= h >> 32;
+    }
+
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccd;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53;
+    h ^= h >> 33;
+    return h;
 }
 
 class HashCmp {
@@ -74,5 +109,3 @@ class HashCmp {
         return k1 == k2;
     }
 };
-
-*/
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "common/integers.h"
+#include <functional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace xld::wasm {
+
+struct LinkerDiagnostic {
+    bool is_error = false;
+    std::string message;
+};
+
+struct LinkResult {
+    // False if the link failed, in which case there is no output.
+    bool ok = false;
+    std::vector<u8> output;
+    // Warnings and errors in the order they were reported
+    std::vector<LinkerDiagnostic> diagnostics;
+};
+
+// Links in the calling process. This is what `xld` does for its command
+// line, except that inputs can be given as buffers, the output is
+// returned as a buffer or written to one provided by the caller, and
+// errors are returned instead of exiting the process.
+//
+//   Linker linker({"--gc-sections", "--export=main"});
+//   linker.add_input("main.o", main_o);
+//   linker.add_input("libc.a", libc_a);
+//   LinkResult result = linker.link();
+//
+// A Linker may link any number of times, and different Linkers may link
+// concurrently. Links share the TBB thread pool of the process; --threads
+// limits the parallelism of the whole process while a link runs.
+class Linker {
+  public:
+    // `args` takes the options of the command line, without the program
+    // name. It may also name input files, which are read before the
+    // inputs given by add_input(). -o is ignored.
+    explicit Linker(std::vector<std::string> args = {});
+
+    // Adds an input file, which may be an object file or an archive.
+    // `name` is used in diagnostics. `data` must stay valid until link()
+    // returns and is never written to.
+    void add_input(std::string name, std::span<const u8> data);
+
+    LinkResult link();
+
+    // Calls `sink` once the size of the output is known, and writes the
+    // output to the buffer it returns. `output` of the result is empty.
+    LinkResult link(const std::function<u8 *(u64 size)> &sink);
+
+  private:
+    struct Input {
+        std::string name;
+        std::span<const u8> data;
+    };
+
+    std::vector<std::string> args;
+    std::vector<Input> inputs;
+};
+
+} // namespace xld::wasm
@@ -7,8 +7,14 @@ void create_internal_file(Context &);
 
 void resolve_symbols(Context &);
 
+void eliminate_comdats(Context &);
+
 void check_undefined(Context &);
 
+void gc_sections(Context &);
+
+void icf_sections(Context &);
+
 void calculate_imports(Context &);
 
 void create_synthetic_sections(Context &);
@@ -25,10 +31,14 @@ void setup_ctors(Context &);
 
 void setup_memory(Context &);
 
+void compress_relocations(Context &);
+
 u64 compute_section_sizes(Context &);
 
 void copy_chunks(Context &);
 
 void apply_reloc(Context &);
 
+void print_stats(Context &);
+
 } // namespace xld::wasm
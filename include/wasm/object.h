@@ -19,6 +19,7 @@
 #include "common/integers.h"
 #include "common/system.h"
 #include <string>
+#include <string_view>
 
 namespace xld::wasm {
 
@@ -296,7 +297,7 @@ struct WasmGlobal {
     // uint32_t index;
     WasmGlobalType type;
     WasmInitExpr init_expr;
-    std::string symbol_name; // from the "linking" section
+    std::string_view symbol_name; // from the "linking" section
 };
 
 struct WasmLimits {
@@ -333,8 +334,8 @@ inline bool import_kind_eq_symtype(u8 kind, WasmSymbolType symty) {
 }
 
 struct WasmImport {
-    std::string module;
-    std::string field;
+    std::string_view module;
+    std::string_view field;
     u8 kind;
     union {
         uint32_t sig_index;
@@ -345,7 +346,7 @@ struct WasmImport {
 };
 
 struct WasmExport {
-    std::string name;
+    std::string_view name;
     u8 kind;
     uint32_t index;
 };
@@ -381,16 +382,16 @@ struct WasmDataReference {
 };
 
 struct WasmSymbolInfo {
-    std::string name;
+    std::string_view name;
     // symtype
     WasmSymbolType kind;
     uint32_t flags;
     // For undefined symbols the module of the import
-    std::optional<std::string> import_module;
+    std::optional<std::string_view> import_module;
     // For undefined symbols the name of the import
-    std::optional<std::string> import_name;
+    std::optional<std::string_view> import_name;
     // For symbols to be exported from the final module
-    std::optional<std::string> export_name;
+    std::optional<std::string_view> export_name;
     union {
         // For function, table, or global symbols, the index in function, table,
         // or global index space.
@@ -425,11 +426,11 @@ struct WasmFunction {
     // use std::shared_ptr?
     u32 sig_index;
     // from the "linking" section
-    std::string symbol_name;
+    std::string_view symbol_name;
     // from the "export" section
-    std::optional<std::string> export_name;
+    std::optional<std::string_view> export_name;
     // from the "name" section
-    std::string debug_name;
+    std::string_view debug_name;
 };
 
 struct WasmDataSegment {
@@ -439,7 +440,7 @@ struct WasmDataSegment {
     // Present if InitFlags & WASM_DATA_SEGMENT_IS_PASSIVE == 0.
     WasmInitExpr offset;
 
-    std::string name; // from the "segment info" section
+    std::string_view name; // from the "segment info" section
     // from the "segmentinfo" subsection in the "linking" section
     uint32_t p2align;
     uint32_t linking_flags;
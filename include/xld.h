@@ -6,6 +6,7 @@
 #include "xld_private/context.h"
 #include "xld_private/input_file.h"
 #include "xld_private/output_elem.h"
+#include "xld_private/server.h"
 #include "xld_private/symbol.h"
 
 namespace xld::wasm {
@@ -16,11 +17,15 @@ const u32 kStackAlign = 16;
 const u32 kHeapAlign = 16;
 const u32 kMinMemoryPages = 2;
 const u32 kMaxMemoryPages = 2;
+// Index of the first element of __indirect_function_table. Index 0 is
+// left empty so that a null function pointer traps when called.
+const u32 kTableBase = 1;
 
 const std::string_view kDefaultMemoryName = "memory";
 
 const std::string_view kDefaultFileName = "a.wasm";
 
-int linker_main(int argc, char **argv);
+// `resident` is given when the link is run by the link server.
+int linker_main(int argc, char **argv, ResidentInputs *resident = nullptr);
 
 } // namespace xld::wasm
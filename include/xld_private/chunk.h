@@ -20,6 +20,26 @@ class OutputLocation {
     u64 content_size = 0;
 };
 
+// Offsets of variable-length records laid out back to back, such as the
+// entries of the export section, from the beginning of the first record.
+// Its member templates are defined in chunk.cc.
+class RecordLayout {
+  public:
+    // Lays out `n` records, where `get_size(i)` is the encoded size of the
+    // i-th record.
+    template <typename F>
+    void compute(size_t n, F get_size);
+
+    // Writes the records to `buf` with `write_record(i, buf)` and advances
+    // `buf` past the last one.
+    template <typename F>
+    void write(u8 *&buf, F write_record);
+
+    std::vector<u64> offsets;
+    // Total size of the records
+    u64 size = 0;
+};
+
 class Chunk {
   public:
     Chunk() : name("<unknown>"), loc(OutputLocation()) {}
@@ -54,6 +74,8 @@ class TypeSection : public Chunk {
 
     u64 compute_section_size(Context &ctx) override;
     void copy_buf(Context &ctx) override;
+
+    RecordLayout types;
 };
 
 class ImportSection : public Chunk {
@@ -65,6 +87,8 @@ class ImportSection : public Chunk {
 
     u64 compute_section_size(Context &ctx) override;
     void copy_buf(Context &ctx) override;
+
+    RecordLayout imports;
 };
 
 class FunctionSection : public Chunk {
@@ -76,6 +100,8 @@ class FunctionSection : public Chunk {
 
     u64 compute_section_size(Context &ctx) override;
     void copy_buf(Context &ctx) override;
+
+    RecordLayout functions;
 };
 
 class TableSection : public Chunk {
@@ -109,6 +135,8 @@ class GlobalSection : public Chunk {
 
     u64 compute_section_size(Context &ctx) override;
     void copy_buf(Context &ctx) override;
+
+    RecordLayout globals;
 };
 
 class ExportSection : public Chunk {
@@ -120,6 +148,9 @@ class ExportSection : public Chunk {
 
     u64 compute_section_size(Context &ctx) override;
     void copy_buf(Context &ctx) override;
+
+    // functions and then globals
+    RecordLayout exports;
 };
 
 class ElemSection : public Chunk {
@@ -131,6 +162,8 @@ class ElemSection : public Chunk {
 
     u64 compute_section_size(Context &ctx) override;
     void copy_buf(Context &ctx) override;
+
+    RecordLayout elements;
 };
 
 class DataCountSection : public Chunk {
@@ -154,6 +187,8 @@ class CodeSection : public Chunk {
     u64 compute_section_size(Context &ctx) override;
     void copy_buf(Context &ctx) override;
     void apply_reloc(Context &ctx) override;
+
+    RecordLayout bodies;
 };
 
 class DataSection : public Chunk {
@@ -182,6 +217,8 @@ class NameSection : public Chunk {
 
     u64 global_subsec_size = 0;
     u64 function_subsec_size = 0;
+    RecordLayout function_names;
+    RecordLayout global_names;
 };
 
 } // namespace xld::wasm
\ No newline at end of file
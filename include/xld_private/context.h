@@ -1,14 +1,16 @@
 #pragma once
 
 #include "common/common.h"
+#include "common/concurrent_map.h"
 #include "common/mmap.h"
 #include "common/system.h"
-#include "oneapi/tbb/concurrent_set.h"
 #include "oneapi/tbb/concurrent_vector.h"
 #include "output_elem.h"
 #include "wasm/object.h"
 #include "xld_private/chunk.h"
 #include "xld_private/input_file.h"
+#include <atomic>
+#include <functional>
 #include <map>
 #include <memory>
 #include <vector>
@@ -18,6 +20,7 @@ namespace xld::wasm {
 // forward-decl
 class InputFile;
 class ObjectFile;
+class ResidentInputs;
 class Symbol;
 
 struct Context {
@@ -28,28 +31,38 @@ struct Context {
     void checkpoint() {
         if (has_error) {
             cleanup();
+            if (throw_on_fatal)
+                throw FatalError();
             _exit(1);
         }
     }
 
     bool has_error = false;
+    // Set for links run by a process which outlives them, such as the
+    // link server. A fatal error then throws FatalError and ends only
+    // the link.
+    bool throw_on_fatal = false;
+    // Receives warnings and errors instead of stderr, if set. Called from
+    // any thread.
+    std::function<void(bool is_error, std::string msg)> diagnostic_handler;
 
     // object pools
     tbb::concurrent_vector<std::unique_ptr<ObjectFile>> obj_pool;
+    tbb::concurrent_vector<std::unique_ptr<Archive>> archive_pool;
     tbb::concurrent_vector<std::unique_ptr<MappedFile>> mf_pool;
     tbb::concurrent_vector<std::unique_ptr<u8[]>> string_pool;
     tbb::concurrent_vector<std::unique_ptr<Chunk>> chunk_pool;
-    tbb::concurrent_vector<std::unique_ptr<InputSection>> isec_pool;
-    tbb::concurrent_vector<std::unique_ptr<InputFragment>> ifrag_pool;
 
     // Symbol table
-    // TODO: use xxHash
-    tbb::concurrent_hash_map<std::string_view, Symbol> symbol_map;
+    ConcurrentMap<Symbol> symbol_map;
+    ConcurrentMap<ComdatGroup> comdat_groups;
 
     std::map<std::string_view, OutputSegment> segments;
 
     // Input files
     std::vector<InputFile *> files;
+    // Archives, whose members are added to `files` only if they are needed
+    std::vector<Archive *> archives;
 
     // Output chunks
     std::vector<Chunk *> chunks;
@@ -74,19 +87,24 @@ struct Context {
     WasmLimits output_memory;
     WasmExport output_memory_export;
 
-    // output imports
-    tbb::concurrent_set<Symbol *> import_functions;
-    tbb::concurrent_set<Symbol *> import_globals;
-
-    tbb::concurrent_vector<Symbol *> functions;
-    tbb::concurrent_vector<Symbol *> globals;
-    tbb::concurrent_vector<Symbol *> data_symbols;
+    // Output imports, functions, globals and exports. They are filled in
+    // input file order, so indices do not depend on thread scheduling.
+    std::vector<Symbol *> import_functions;
+    std::vector<Symbol *> import_globals;
+
+    std::vector<Symbol *> functions;
+    // Functions folded by --icf. They share an index with their leader.
+    std::vector<Symbol *> folded_functions;
+    // Function bodies rewritten by --compress-relocations
+    std::vector<std::vector<u8>> compressed_bodies;
+    std::vector<Symbol *> globals;
+    std::vector<Symbol *> data_symbols;
     tbb::concurrent_vector<OutputSegment> output_segments;
     tbb::concurrent_vector<WasmTableType> tables;
 
-    tbb::concurrent_vector<Symbol *> export_functions;
-    tbb::concurrent_vector<Symbol *> export_globals;
-    tbb::concurrent_vector<Symbol *> export_datas;
+    std::vector<Symbol *> export_functions;
+    std::vector<Symbol *> export_globals;
+    std::vector<Symbol *> export_datas;
 
     std::vector<WasmSignature> signatures;
 
@@ -95,14 +113,43 @@ struct Context {
     // Command-line arguments
     struct {
         bool export_all = false;
+        std::vector<std::string> export_symbols;
         bool allow_undefined = false;
         std::string output_file;
         bool dump_input = false;
+        bool gc_sections = false;
+        bool print_gc_sections = false;
+        bool icf = false;
+        bool icf_all = false;
+        bool compress_relocations = false;
+        bool stats = false;
+        // 0 means the default
+        i64 thread_count = 0;
+        bool verbose = false;
+        // Bitmask of DebugKind
+        u32 debug = 0;
 
         bool color_diagnostics = true;
         std::string chroot;
+        // Directory of the parse cache, or empty if disabled
+        std::string cache_dir;
+        // Write indices of the input archives instead of linking
+        bool index_archive = false;
+        // Socket of --server, or of the server to send the link to
+        std::string server;
+        std::string connect;
+        // Job file of --batch
+        std::string batch;
     } arg;
 
+    // Inputs kept by the link server or shared by the links of --batch,
+    // or nullptr if this link is run on its own
+    ResidentInputs *resident = nullptr;
+
+    // Parse cache statistics, printed by --stats
+    std::atomic<i64> num_cache_hits = 0;
+    std::atomic<i64> num_cache_misses = 0;
+
     u8 *buf = nullptr;
 };
 
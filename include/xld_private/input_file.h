@@ -1,32 +1,37 @@
 #pragma once
 
+#include "common/arena.h"
+#include "common/archive_index.h"
 #include "common/mmap.h"
 #include "common/system.h"
 #include "wasm/symbol.h"
 #include "xld_private/chunk.h"
 #include <atomic>
+#include <functional>
+#include <mutex>
 
 namespace xld::wasm {
 
 // forward-decl
 class Context;
 class ObjectFile;
+class Symbol;
 
 class InputSection {
   public:
-    InputSection(u8 sec_id, u32 index, ObjectFile *obj, std::string name,
+    InputSection(u8 sec_id, u32 index, ObjectFile *obj, std::string_view name,
                  std::span<const u8> span)
         : sec_id(sec_id), index(index), obj(obj), name(name), span(span) {}
 
     void write_to(Context &ctx, u8 *buf);
     u64 get_size();
-    void apply_reloc(Context &ctx, u64 osec_content_offset);
+    std::span<const u8> get_span() { return span; }
 
     u8 sec_id;
     // section index in the object file
     u32 index;
     ObjectFile *obj;
-    std::string name;
+    std::string_view name;
     std::vector<WasmRelocation> relocs;
 
     u64 out_offset = 0;
@@ -44,21 +49,58 @@ class InputFragment {
     void write_to(Context &ctx, u8 *buf);
     u64 get_size();
     void apply_reloc(Context &ctx, u64 osec_content_offset);
+    // Applies relocations to a data segment written at `seg_buf` whose
+    // virtual address is `seg_va`
+    void apply_data_reloc(Context &ctx, u8 *seg_buf, u32 seg_va);
 
     u32 sec_index;
     ObjectFile *obj;
-    std::vector<WasmRelocation> relocs;
+    // Relocations applied to this fragment. Points into the relocations
+    // of the input section.
+    std::span<WasmRelocation> relocs;
     // offset from beginning of the content of the input section
     // not pointing the first number of bytes instead the following content.
     u64 in_offset = 0;
     // offset from beginning of the content of the output section
     u64 out_offset = 0;
     u64 out_size_offset = 0;
+    // offset from beginning of the output segment. Only for data segments.
+    u32 seg_offset = 0;
+
+    // False if removed by COMDAT elimination, --gc-sections or --icf
+    std::atomic_bool is_alive = true;
+    // Used by gc_sections() to visit each fragment only once
+    std::atomic_bool is_visited = false;
+    // The function body this one was folded into by --icf, or nullptr
+    InputFragment *leader = nullptr;
 
     // does not contain size info. Only its body.
     std::span<const u8> span;
 };
 
+// Defined in reloc.cc
+std::string_view get_reloc_type_name(u8 type);
+bool is_known_reloc_type(u8 type);
+
+// A COMDAT group is a set of functions and data segments which is
+// included at most once in the output, such as a C++ inline function.
+// All files defining a group of the same name share one ComdatGroup.
+struct ComdatGroup {
+    // Priority of the file whose copy of the group is kept. The file with
+    // the lowest priority wins, so the choice does not depend on timing.
+    std::atomic<i64> owner = INT64_MAX;
+};
+
+// A file's copy of a COMDAT group
+struct ComdatGroupRef {
+    ComdatGroup *group;
+    // Points into the mapped file
+    std::string_view name;
+    // function indices (including imports) and data segment indices
+    std::vector<u32> functions;
+    std::vector<u32> data_segments;
+};
+
 class InputFile {
   public:
     // Only object file is supported
@@ -81,7 +123,20 @@ class InputFile {
     std::string filename;
     Kind kind = Object;
 
+    // Files given on the command line are always linked. Archive members
+    // start out dead and are brought to life by resolve_symbols() when
+    // they define a symbol that is otherwise undefined.
+    std::atomic_bool is_alive = true;
+
+    // Position on the command line, with archive members numbered in
+    // their order within the archive. Lower is higher priority.
+    i64 priority = 0;
+
     std::vector<WasmSymbol> symbols;
+    // Resolved symbols, indexed in the same way as `symbols` and filled by
+    // resolve_symbols(). Global and weak symbols point into the global
+    // symbol table and local symbols point into `local_syms`.
+    std::vector<Symbol *> syms;
 };
 
 class ObjectFile : public InputFile {
@@ -107,6 +162,15 @@ class ObjectFile : public InputFile {
     bool is_valid_section_symbol(u32 index);
 
     void parse(Context &ctx);
+    // --cache-dir support, defined in parse_cache.cc
+    bool load_parse_cache(Context &ctx);
+    void save_parse_cache(Context &ctx);
+    // Serializes the state parse() builds, or restores it. Views into
+    // the input are saved as offsets, so `mf` must have the same
+    // contents when the state is restored. Other views point into
+    // `payload`, which must outlive this file.
+    std::vector<u8> save_parse_state();
+    bool restore_parse_state(Context &ctx, std::span<const u8> payload);
     // parse custom sections
     void parse_linking_sec(Context &ctx, const u8 *&p, const u32 size);
     void parse_reloc_sec(Context &ctx, const u8 *&p, const u32 size);
@@ -118,11 +182,18 @@ class ObjectFile : public InputFile {
 
     void dump(Context &ctx);
 
+    // Owns the input sections and fragments of this file, which are
+    // laid out contiguously in the order they appear in the file.
+    Arena arena;
+
     // Spans of all sections
     std::vector<InputSection *> sections;
     std::vector<InputSection *> customs;
 
     std::vector<WasmSignature> signatures;
+    // Output type index of each entry of `signatures`, set by
+    // calculate_types(). Only entries used by live code are meaningful.
+    std::vector<u32> type_indices;
     std::vector<WasmImport> imports;
     // TODO: table section
     std::vector<WasmFunction> functions;
@@ -133,7 +204,7 @@ class ObjectFile : public InputFile {
     std::vector<WasmElemSegment> elem_segments;
 
     // from the "name" section
-    std::string module_name;
+    std::string_view module_name;
     // from the "datacount" and "data" sections
     u32 data_count = 0;
     std::vector<WasmDataSegment> data_segments;
@@ -141,6 +212,9 @@ class ObjectFile : public InputFile {
 
     // from the "linking" section
     WasmLinkingData linking_data;
+    std::vector<ComdatGroupRef> comdat_groups;
+
+    std::vector<Symbol> local_syms;
 
     u32 num_imported_globals = 0;
     u32 num_imported_functions = 0;
@@ -151,4 +225,40 @@ class ObjectFile : public InputFile {
     ObjectFile(Context &ctx, const std::string &filename, MappedFile *mf);
 };
 
+void read_defined_symbols(
+    Context &ctx, MappedFile *mf,
+    const std::function<void(std::string_view)> &fn);
+
+// A static library. Its members are not read up front. When a symbol is
+// undefined, the member which defines it is looked up in the archive
+// index and only then turned into an ObjectFile, so linking against a
+// library costs little more than the members that are actually used.
+class Archive {
+  public:
+    static Archive *create(Context &ctx, MappedFile *mf);
+    // Implements --index-archive
+    static void write_index(Context &ctx, MappedFile *mf);
+
+    // Returns the member which defines `name`, or nullptr. The member is
+    // created on first use and starts out dead.
+    ObjectFile *find_member(Context &ctx, std::string_view name, u64 hash);
+
+    MappedFile *mf;
+    ArchiveIndex index;
+    // Priority of the first member. Members are numbered in archive order.
+    i64 priority = 0;
+
+  private:
+    Archive(MappedFile *mf) : mf(mf) {}
+
+    // Holds the index if it was built by this process
+    std::vector<u8> index_buf;
+    // Member files if the index was built by this process. Otherwise
+    // members are sliced out of the archive using the index.
+    std::vector<MappedFile *> member_files;
+
+    std::mutex mu;
+    std::vector<ObjectFile *> members;
+};
+
 } // namespace xld::wasm
\ No newline at end of file
@@ -15,25 +15,19 @@ class OutputSegment {
                                         const std::string_view &name);
     OutputSegment(const OutputSegment &) = delete;
 
-    OutputSegment(std::string_view name) : name(name), ifrag_map() {
+    OutputSegment(std::string_view name) : name(name) {
         // TODO: OK?
         memory_index = 0;
-        p2align = 1;
+        p2align = 0;
     };
 
+    // Appends `ifrag` and sets its offset within this segment.
     void merge(Context &ctx, const WasmDataSegment &seg, InputFragment *ifrag);
 
     void set_virtual_address(i32 va);
 
     i32 get_virtual_address() const;
 
-    std::optional<u32> get_frag_offset(const std::string_view &frag_name) {
-        auto it = ifrag_map.find(frag_name);
-        if (it == ifrag_map.end())
-            return std::nullopt;
-        return it->second.second;
-    }
-
     std::string_view get_name() const { return name; }
 
     u32 get_size() const { return size; }
@@ -45,11 +39,7 @@ class OutputSegment {
         return 0;
     }
 
-    tbb::concurrent_map<std::string_view, std::pair<InputFragment *, u32>> const
-        &
-        get_ifrag_map() const {
-        return ifrag_map;
-    }
+    const std::vector<InputFragment *> &get_ifrags() const { return ifrags; }
 
     u32 p2align;
 
@@ -57,15 +47,14 @@ class OutputSegment {
 
   private:
     std::string_view name;
-    // segment name -> (input fragment, offset)
-    tbb::concurrent_map<std::string_view, std::pair<InputFragment *, u32>>
-        ifrag_map;
-    u32 init_flags;
+    // input data segments in the order they are laid out
+    std::vector<InputFragment *> ifrags;
+    u32 init_flags = 0;
     u32 memory_index;
-    u32 linking_flags;
-    u32 size;
+    u32 linking_flags = 0;
+    u32 size = 0;
     // virtual address
-    u32 va;
+    u32 va = 0;
 };
 
 // Represents Elem section for now
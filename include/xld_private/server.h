@@ -0,0 +1,72 @@
+#pragma once
+
+#include "common/mmap.h"
+#include "common/system.h"
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace xld::wasm {
+
+// forward-decl
+class Context;
+class ObjectFile;
+
+// Inputs which the link server keeps between links, and which the links
+// of a --batch invocation share. Files stay mapped,
+// archive indices are kept, and so is the state ObjectFile::parse()
+// builds for each object file and archive member, in the form of
+// ObjectFile::save_parse_state(). Everything kept for a file is dropped
+// once its size or modification time changes.
+//
+// Entries replaced while links are running are freed only once no link
+// may refer to them anymore.
+class ResidentInputs {
+  public:
+    // Opens `path`, reusing the mapping of an earlier link if the file
+    // has not changed since.
+    MappedFile *open_file(Context &ctx, const std::string &path);
+
+    bool load_parse_state(Context &ctx, ObjectFile &obj);
+    void save_parse_state(ObjectFile &obj);
+
+    // Returns the index saved for the archive `mf`, or an empty span.
+    std::span<const u8> get_archive_index(MappedFile *mf);
+    void save_archive_index(MappedFile *mf, std::span<const u8> index);
+
+    // Frees the replaced entries. No link may be running.
+    void release_replaced();
+
+  private:
+    struct Entry {
+        i64 size = 0;
+        i64 mtime = 0;
+        std::unique_ptr<MappedFile> mf;
+        // Set at most once, so that views into them stay valid
+        std::vector<u8> parse_state;
+        std::vector<u8> archive_index;
+    };
+
+    Entry &get_entry(const std::string &key, i64 size, i64 mtime);
+
+    std::mutex mu;
+    std::unordered_map<std::string, std::unique_ptr<Entry>> entries;
+    std::vector<std::unique_ptr<Entry>> replaced;
+};
+
+// Implements --server. Links sent by clients run in this process, one at
+// a time, and share a ResidentInputs.
+int run_server(Context &ctx);
+
+// Implements --connect. Sends the command line to the server and
+// returns the exit status of the link.
+int run_client(Context &ctx, int argc, char **argv);
+
+// Implements --batch. Runs the links listed in a file concurrently and
+// returns 1 if any of them failed.
+int run_batch(Context &ctx);
+
+} // namespace xld::wasm
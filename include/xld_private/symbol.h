@@ -10,9 +10,12 @@ class InputFile;
 
 u32 get_rank(const WasmSymbol &wsym);
 
-// Global or weak symbol. This class is not instanciated for local symbols.
+// Global or weak symbol, which is shared through the global symbol table.
+// Each object file also has its own Symbols for its local symbols in
+// ObjectFile::local_syms, which are not in the global table.
 class Symbol {
   public:
+    Symbol() = default;
     Symbol(std::string_view name, ObjectFile *file) : name(name), file(file) {}
 
     Symbol(const Symbol &) = delete;
@@ -25,7 +28,7 @@ class Symbol {
     ObjectFile *file = nullptr;
     u32 elem_index = 0;
 
-    InputFragment *ifrag;
+    InputFragment *ifrag = nullptr;
 
     std::mutex mu;
 
@@ -40,12 +43,16 @@ class Symbol {
 
     // whether or not the symbol is originally exported
     bool is_exported = false;
-    bool is_alive = false;
+    // Set by gc_sections() if the symbol is referenced by live code or data
+    std::atomic_bool is_alive = false;
 
     // output index
     u32 index = 0;
     // output sig_index
     u32 sig_index = 0;
+    // Index in __indirect_function_table, or 0 if the function is not
+    // in the table
+    u32 table_index = 0;
 
     i32 virtual_address = 0;
 
@@ -60,6 +67,8 @@ class Symbol {
     } visibility = Visibility::Default;
 };
 
+Symbol *get_symbol(Context &ctx, std::string_view name, u64 hash);
+
 Symbol *get_symbol(Context &ctx, std::string_view name);
 
 bool should_export_symbol(Context &ctx, Symbol *sym);
@@ -0,0 +1,178 @@
+// This file implements Archive, which reads the members of a static
+// library on demand using an archive index.
+//
+// The index of an archive is taken from the first of these that is up
+// to date:
+//
+//  1. <archive>.xldidx next to the archive, written by
+//     `xld --index-archive <archive>`
+//  2. an index saved in the --cache-dir directory by an earlier link
+//  3. an index kept by the link server from an earlier link
+//  4. an index built now from the archive symbol table or, if there is
+//     none, from the symbol tables of the members. It is saved to the
+//     --cache-dir directory and kept by the link server, if any.
+//
+// Thin archives are always indexed anew, since their member files can
+// change without the archive changing. So are archives given in memory
+// through the Linker API, which have no modification time to check an
+// index against.
+
+#include "common/archive_file.h"
+#include "common/file.h"
+#include "oneapi/tbb/parallel_for.h"
+#include "xld.h"
+#include <unordered_map>
+
+namespace xld::wasm {
+
+// Lists the members of `mf` and the symbols each of them defines. The
+// names are taken from the archive symbol table or, if there is none,
+// from the members, which are then read in parallel.
+static std::vector<ArchiveIndexInput>
+read_index_inputs(Context &ctx, MappedFile *mf,
+                  std::vector<MappedFile *> &mfs) {
+    std::vector<u64> hdr_offsets;
+    mfs = read_archive_members(ctx, mf, &hdr_offsets);
+    bool is_thin = get_file_type(ctx, mf) == FileType::THIN_AR;
+
+    std::vector<ArchiveIndexInput> inputs(mfs.size());
+    for (size_t i = 0; i < mfs.size(); i++) {
+        inputs[i].name = mfs[i]->name;
+        inputs[i].hdr_offset = hdr_offsets[i];
+        inputs[i].offset = is_thin ? 0 : mfs[i]->data - mf->data;
+        inputs[i].size = mfs[i]->size;
+    }
+
+    std::vector<ArSymbol> symtab = read_archive_symtab(ctx, mf);
+    if (symtab.empty()) {
+        tbb::parallel_for((size_t)0, mfs.size(), [&](size_t i) {
+            read_defined_symbols(ctx, mfs[i], [&](std::string_view name) {
+                inputs[i].symbols.push_back(name);
+            });
+        });
+        return inputs;
+    }
+
+    std::unordered_map<u64, i64> offset_to_member;
+    for (size_t i = 0; i < inputs.size(); i++)
+        offset_to_member[inputs[i].hdr_offset] = i;
+
+    for (ArSymbol &ent : symtab) {
+        auto it = offset_to_member.find(ent.hdr_offset);
+        if (it == offset_to_member.end())
+            Fatal(ctx) << mf->name << ": archive symbol table refers to a "
+                       << "nonexistent member: " << ent.name;
+        inputs[it->second].symbols.push_back(ent.name);
+    }
+    return inputs;
+}
+
+static std::string get_cached_index_path(Context &ctx, MappedFile *mf) {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx",
+             (unsigned long long)hash_string(mf->name));
+    return ctx.arg.cache_dir + "/" + name + std::string(kArchiveIndexSuffix);
+}
+
+Archive *Archive::create(Context &ctx, MappedFile *mf) {
+    Archive *ar = new Archive(mf);
+    ctx.archive_pool.push_back(std::unique_ptr<Archive>(ar));
+    bool is_thin = get_file_type(ctx, mf) == FileType::THIN_AR;
+    bool reuse_index = !is_thin && !mf->is_borrowed;
+
+    auto try_open = [&](const std::string &path) {
+        std::string error;
+        MappedFile *idx = open_file_impl(path, error);
+        if (!idx || !error.empty()) {
+            delete idx;
+            return false;
+        }
+        ctx.mf_pool.push_back(std::unique_ptr<MappedFile>(idx));
+        if (!ar->index.open({idx->data, (size_t)idx->size}, mf))
+            return false;
+        Debug(ctx, DEBUG_INPUT) << mf->name << ": using index " << path;
+        return true;
+    };
+
+    bool found = false;
+    if (reuse_index) {
+        found = try_open(mf->name + std::string(kArchiveIndexSuffix));
+        if (!found && !ctx.arg.cache_dir.empty())
+            found = try_open(get_cached_index_path(ctx, mf));
+        if (!found && ctx.resident)
+            found = ar->index.open(ctx.resident->get_archive_index(mf), mf);
+    }
+
+    if (!found) {
+        std::vector<ArchiveIndexInput> inputs =
+            read_index_inputs(ctx, mf, ar->member_files);
+        ar->index_buf = build_archive_index(mf, inputs);
+        bool ok = ar->index.open(ar->index_buf, mf);
+        ASSERT(ok);
+        (void)ok;
+
+        if (reuse_index && !ctx.arg.cache_dir.empty())
+            if (!write_file_atomic(get_cached_index_path(ctx, mf),
+                                   ar->index_buf))
+                Warn(ctx) << "cannot write to cache directory "
+                          << ctx.arg.cache_dir << ": " << errno_string();
+        if (reuse_index && ctx.resident)
+            ctx.resident->save_archive_index(mf, ar->index_buf);
+    }
+
+    ar->members.resize(ar->index.members.size());
+    return ar;
+}
+
+void Archive::write_index(Context &ctx, MappedFile *mf) {
+    switch (get_file_type(ctx, mf)) {
+    case FileType::AR:
+        break;
+    case FileType::THIN_AR:
+        Error(ctx) << mf->name << ": cannot index a thin archive";
+        return;
+    default:
+        Error(ctx) << mf->name << ": not an archive";
+        return;
+    }
+
+    std::vector<MappedFile *> mfs;
+    std::vector<u8> buf =
+        build_archive_index(mf, read_index_inputs(ctx, mf, mfs));
+    std::string path = mf->name + std::string(kArchiveIndexSuffix);
+    if (!write_file_atomic(path, buf))
+        Error(ctx) << "cannot write " << path << ": " << errno_string();
+}
+
+ObjectFile *Archive::find_member(Context &ctx, std::string_view name,
+                                 u64 hash) {
+    i64 i = index.find(name, hash);
+    if (i == -1)
+        return nullptr;
+
+    std::scoped_lock lock(mu);
+    if (members[i])
+        return members[i];
+
+    MappedFile *member_mf;
+    if (!member_files.empty()) {
+        member_mf = member_files[i];
+    } else {
+        const ArchiveIndexMember &ent = index.members[i];
+        if (ent.offset + ent.size > (u64)mf->size)
+            Fatal(ctx) << mf->name << ": corrupted archive index";
+        std::string_view member_name =
+            index.get_string(ent.name_offset, ent.name_size);
+        member_mf = mf->slice(ctx, std::string(member_name), ent.offset,
+                              ent.size);
+    }
+
+    ObjectFile *obj = ObjectFile::create(
+        ctx, mf->name + "(" + member_mf->name + ")", member_mf);
+    obj->is_alive = false;
+    obj->priority = priority + i;
+    members[i] = obj;
+    return obj;
+}
+
+} // namespace xld::wasm
@@ -0,0 +1,92 @@
+// This file implements --batch, which produces many outputs in one
+// invocation.
+//
+// A unit test matrix links many small programs against the same
+// libraries. Linked one by one, each program maps, indexes and parses
+// the libraries again. `xld --batch <file>` runs all the links of a job
+// file concurrently on the TBB pool instead. Each link has its own
+// Context, and thus its own symbol table and output chunks, while the
+// inputs are shared through a ResidentInputs just like the link server
+// shares them between its links. A file read by several links is mapped
+// and indexed once, and every link but those racing the first one
+// restores its parse state instead of parsing it.
+//
+// Each line of the job file is the command line of one link without
+// the program name, such as `main.o libc.a -o main.wasm`. Arguments are
+// separated by whitespace. Empty lines and lines starting with '#' are
+// ignored. The jobs share the thread pool, so --threads applies only to
+// the `xld --batch` command line and is ignored in a job line.
+
+#include "common/file.h"
+#include "xld.h"
+
+namespace xld::wasm {
+
+namespace {
+struct BatchJob {
+    i64 lineno = 0;
+    std::string line;
+    std::vector<std::string> args;
+    i32 status = 0;
+};
+} // namespace
+
+static std::vector<BatchJob> read_batch_file(MappedFile *mf) {
+    std::vector<BatchJob> jobs;
+    std::string_view contents = mf->get_contents();
+    for (i64 lineno = 1; !contents.empty(); lineno++) {
+        size_t pos = contents.find('\n');
+        std::string_view line = contents.substr(0, pos);
+        contents = (pos == contents.npos) ? "" : contents.substr(pos + 1);
+
+        BatchJob job;
+        job.lineno = lineno;
+        job.line = line;
+        while (!line.empty()) {
+            size_t begin = line.find_first_not_of(" \t\r");
+            if (begin == line.npos)
+                break;
+            line = line.substr(begin);
+            size_t end = line.find_first_of(" \t\r");
+            job.args.push_back(std::string(line.substr(0, end)));
+            line = (end == line.npos) ? "" : line.substr(end);
+        }
+
+        if (!job.args.empty() && !job.args[0].starts_with('#'))
+            jobs.push_back(std::move(job));
+    }
+    return jobs;
+}
+
+int run_batch(Context &ctx) {
+    std::vector<BatchJob> jobs =
+        read_batch_file(must_open_file(ctx, ctx.arg.batch));
+
+    ResidentInputs resident;
+    tbb::parallel_for_each(jobs, [&](BatchJob &job) {
+        std::vector<char *> argv = {(char *)"xld"};
+        for (std::string &arg : job.args)
+            argv.push_back(arg.data());
+        argv.push_back(nullptr);
+
+        try {
+            job.status = linker_main(argv.size() - 1, argv.data(), &resident);
+        } catch (FatalError &) {
+            job.status = 1;
+        } catch (std::exception &e) {
+            // Do not let one job cancel the others.
+            report(ctx, "error", true,
+                   ctx.arg.batch + ":" + std::to_string(job.lineno) + ": " +
+                       e.what());
+            job.status = 1;
+        }
+    });
+
+    for (BatchJob &job : jobs)
+        if (job.status)
+            Error(ctx) << ctx.arg.batch << ":" << job.lineno
+                       << ": link failed: " << job.line;
+    return ctx.has_error ? 1 : 0;
+}
+
+} // namespace xld::wasm
@@ -3,6 +3,8 @@
 #include "common/log.h"
 #include "wasm/object.h"
 #include "wasm/utils.h"
+#include "oneapi/tbb/parallel_for.h"
+#include "oneapi/tbb/parallel_scan.h"
 #include "xld.h"
 #include "xld_private/output_elem.h"
 
@@ -73,6 +75,49 @@ static u32 get_limits_size(WasmLimits &limits) {
     return size;
 }
 
+// Records are laid out and written in blocks of this many
+static constexpr size_t kRecordGrainSize = 1024;
+
+// Sizes of the records are computed in parallel and turned into offsets by
+// a parallel prefix sum, so that no part of the layout takes serial time
+// proportional to the number of records.
+template <typename F>
+void RecordLayout::compute(size_t n, F get_size) {
+    offsets.resize(n);
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, n, kRecordGrainSize),
+                      [&](const tbb::blocked_range<size_t> &r) {
+                          for (size_t i = r.begin(); i < r.end(); i++)
+                              offsets[i] = get_size(i);
+                      });
+
+    size = tbb::parallel_scan(
+        tbb::blocked_range<size_t>(0, n, kRecordGrainSize), (u64)0,
+        [&](const tbb::blocked_range<size_t> &r, u64 sum, bool is_final) {
+            for (size_t i = r.begin(); i < r.end(); i++) {
+                u64 record_size = offsets[i];
+                if (is_final)
+                    offsets[i] = sum;
+                sum += record_size;
+            }
+            return sum;
+        },
+        std::plus<u64>());
+}
+
+template <typename F>
+void RecordLayout::write(u8 *&buf, F write_record) {
+    u8 *const beg = buf;
+    tbb::parallel_for(
+        tbb::blocked_range<size_t>(0, offsets.size(), kRecordGrainSize),
+        [&](const tbb::blocked_range<size_t> &r) {
+            for (size_t i = r.begin(); i < r.end(); i++) {
+                u8 *p = beg + offsets[i];
+                write_record(i, p);
+            }
+        });
+    buf += size;
+}
+
 static void finalize_section_size_common(u64 &size) {
     size++;
     size += get_varuint32_size(size);
@@ -91,13 +136,16 @@ void OutputWhdr::copy_buf(Context &ctx) {
 u64 TypeSection::compute_section_size(Context &ctx) {
     u64 size = 0;
     size += get_varuint32_size(ctx.signatures.size()); // number of types
-    for (auto &sig : ctx.signatures) {
-        size++;
-        size += get_varuint32_size(sig.params.size());
-        size += sig.params.size();
-        size += get_varuint32_size(sig.returns.size());
-        size += sig.returns.size();
-    }
+    types.compute(ctx.signatures.size(), [&](size_t i) {
+        WasmSignature &sig = ctx.signatures[i];
+        u64 rec_size = 1;
+        rec_size += get_varuint32_size(sig.params.size());
+        rec_size += sig.params.size();
+        rec_size += get_varuint32_size(sig.returns.size());
+        rec_size += sig.returns.size();
+        return rec_size;
+    });
+    size += types.size;
     loc.content_size = size;
     finalize_section_size_common(size);
     return size;
@@ -109,30 +157,34 @@ void TypeSection::copy_buf(Context &ctx) {
     write_varuint32(buf, loc.content_size);
 
     write_varuint32(buf, ctx.signatures.size());
-    for (auto &sig : ctx.signatures) {
-        write_byte(buf, WASM_TYPE_FUNC);
-        write_varuint32(buf, sig.params.size());
+    types.write(buf, [&](size_t i, u8 *&p) {
+        WasmSignature &sig = ctx.signatures[i];
+        write_byte(p, WASM_TYPE_FUNC);
+        write_varuint32(p, sig.params.size());
         for (auto param : sig.params) {
-            write_byte(buf, param);
+            write_byte(p, param);
         }
-        write_varuint32(buf, sig.returns.size());
+        write_varuint32(p, sig.returns.size());
         for (auto ret : sig.returns) {
-            write_byte(buf, ret);
+            write_byte(p, ret);
         }
-    }
+    });
 }
 
 u64 ImportSection::compute_section_size(Context &ctx) {
     u64 size = 0;
     u32 num_imports = ctx.import_functions.size();
     size += get_varuint32_size(num_imports); // number of imports
-    for (Symbol *sym : ctx.import_functions) {
+    imports.compute(ctx.import_functions.size(), [&](size_t i) {
+        Symbol *sym = ctx.import_functions[i];
         // FIXME: Should not be "env"?
-        size += get_name_size("env");
-        size += get_name_size(sym->name);
-        size += 1;                                  // kind
-        size += get_varuint32_size(sym->sig_index); // type index
-    }
+        u64 rec_size = get_name_size("env");
+        rec_size += get_name_size(sym->name);
+        rec_size += 1;                                  // kind
+        rec_size += get_varuint32_size(sym->sig_index); // type index
+        return rec_size;
+    });
+    size += imports.size;
     // TODO: globals
     loc.content_size = size;
     finalize_section_size_common(size);
@@ -146,21 +198,23 @@ void ImportSection::copy_buf(Context &ctx) {
 
     u32 num_imports = ctx.import_functions.size();
     write_varuint32(buf, num_imports);
-    for (Symbol *sym : ctx.import_functions) {
-        write_name(buf, "env");
-        write_name(buf, sym->name);
-        write_byte(buf, WASM_EXTERNAL_FUNCTION);
-        write_varuint32(buf, sym->sig_index);
-    }
+    imports.write(buf, [&](size_t i, u8 *&p) {
+        Symbol *sym = ctx.import_functions[i];
+        write_name(p, "env");
+        write_name(p, sym->name);
+        write_byte(p, WASM_EXTERNAL_FUNCTION);
+        write_varuint32(p, sym->sig_index);
+    });
     // TODO: globals
 }
 
 u64 FunctionSection::compute_section_size(Context &ctx) {
     u64 size = 0;
     size += get_varuint32_size(ctx.functions.size()); // number of functions
-    for (Symbol *sym : ctx.functions) {
-        size += get_varuint32_size(sym->sig_index);
-    }
+    functions.compute(ctx.functions.size(), [&](size_t i) {
+        return get_varuint32_size(ctx.functions[i]->sig_index);
+    });
+    size += functions.size;
     loc.content_size = size;
     finalize_section_size_common(size);
     return size;
@@ -172,9 +226,9 @@ void FunctionSection::copy_buf(Context &ctx) {
     write_varuint32(buf, loc.content_size);
 
     write_varuint32(buf, ctx.functions.size());
-    for (Symbol *sym : ctx.functions) {
-        write_varuint32(buf, sym->sig_index);
-    }
+    functions.write(buf, [&](size_t i, u8 *&p) {
+        write_varuint32(p, ctx.functions[i]->sig_index);
+    });
     ASSERT(buf == ctx.buf + loc.offset + loc.size);
 }
 
@@ -249,16 +303,20 @@ static void write_init_expr(Context &ctx, u8 *&buf, WasmInitExpr &init_expr) {
 u64 GlobalSection::compute_section_size(Context &ctx) {
     u64 size = 0;
     size += get_varuint32_size(ctx.globals.size()); // number of globals
-    for (Symbol *sym : ctx.globals) {
+    globals.compute(ctx.globals.size(), [&](size_t i) {
+        Symbol *sym = ctx.globals[i];
         WasmGlobal &global = sym->file->globals[sym->elem_index];
-        size++; // valtype
-        size++; // mut
+        u64 rec_size = 0;
+        rec_size++; // valtype
+        rec_size++; // mut
         if (global.init_expr.body.has_value()) {
-            size += global.init_expr.body.value().size();
+            rec_size += global.init_expr.body.value().size();
         } else {
-            size += get_init_expr_size(ctx, global.init_expr);
+            rec_size += get_init_expr_size(ctx, global.init_expr);
         }
-    }
+        return rec_size;
+    });
+    size += globals.size;
     loc.content_size = size;
     finalize_section_size_common(size);
     return size;
@@ -272,18 +330,19 @@ void GlobalSection::copy_buf(Context &ctx) {
 
     // globals
     write_varuint32(buf, ctx.globals.size());
-    for (Symbol *sym : ctx.globals) {
+    globals.write(buf, [&](size_t i, u8 *&p) {
+        Symbol *sym = ctx.globals[i];
         WasmGlobal &global = sym->file->globals[sym->elem_index];
-        write_byte(buf, global.type.type);
-        write_byte(buf, global.type.mut);
+        write_byte(p, global.type.type);
+        write_byte(p, global.type.mut);
         if (global.init_expr.body.has_value()) {
-            memcpy(buf, global.init_expr.body.value().data(),
+            memcpy(p, global.init_expr.body.value().data(),
                    global.init_expr.body.value().size());
-            buf += global.init_expr.body.value().size();
+            p += global.init_expr.body.value().size();
         } else {
-            write_init_expr(ctx, buf, global.init_expr);
+            write_init_expr(ctx, p, global.init_expr);
         }
-    }
+    });
 
     ASSERT(buf == ctx.buf + loc.offset + loc.size);
 }
@@ -350,18 +409,18 @@ u64 ExportSection::compute_section_size(Context &ctx) {
     size += 1;
     size += get_varuint32_size(0);
 
-    // functions
-    for (Symbol *sym : ctx.export_functions) {
-        size += get_name_size(sym->name);
-        size += 1;
-        size += get_varuint32_size(sym->index);
-    }
-    // globals
-    for (Symbol *sym : ctx.export_globals) {
-        size += get_name_size(sym->name);
-        size += 1;
-        size += get_varuint32_size(sym->index);
-    }
+    // functions and globals
+    u32 num_functions = ctx.export_functions.size();
+    exports.compute(num_functions + ctx.export_globals.size(), [&](size_t i) {
+        Symbol *sym = (i < num_functions)
+                          ? ctx.export_functions[i]
+                          : ctx.export_globals[i - num_functions];
+        u64 rec_size = get_name_size(sym->name);
+        rec_size += 1;
+        rec_size += get_varuint32_size(sym->index);
+        return rec_size;
+    });
+    size += exports.size;
     loc.content_size = size;
     finalize_section_size_common(size);
     return size;
@@ -375,24 +434,27 @@ void ExportSection::copy_buf(Context &ctx) {
 
     u32 num_exports =
         1 + ctx.export_functions.size() + ctx.export_globals.size();
-    write_varint32(buf, num_exports);
+    write_varuint32(buf, num_exports);
 
     // memory
     write_name(buf, kDefaultMemoryName);
     write_byte(buf, WASM_EXTERNAL_MEMORY);
     write_varuint32(buf, 0);
-    // functions
-    for (Symbol *sym : ctx.export_functions) {
-        write_name(buf, sym->name);
-        write_byte(buf, WASM_EXTERNAL_FUNCTION);
-        write_varuint32(buf, sym->index);
-    }
-    // globals
-    for (Symbol *sym : ctx.export_globals) {
-        write_name(buf, sym->name);
-        write_byte(buf, WASM_EXTERNAL_GLOBAL);
-        write_varuint32(buf, sym->index);
-    }
+    // functions and globals
+    u32 num_functions = ctx.export_functions.size();
+    exports.write(buf, [&](size_t i, u8 *&p) {
+        if (i < num_functions) {
+            Symbol *sym = ctx.export_functions[i];
+            write_name(p, sym->name);
+            write_byte(p, WASM_EXTERNAL_FUNCTION);
+            write_varuint32(p, sym->index);
+        } else {
+            Symbol *sym = ctx.export_globals[i - num_functions];
+            write_name(p, sym->name);
+            write_byte(p, WASM_EXTERNAL_GLOBAL);
+            write_varuint32(p, sym->index);
+        }
+    });
 
     ASSERT(buf == ctx.buf + loc.offset + loc.size);
 }
@@ -404,14 +466,14 @@ u64 ElemSection::compute_section_size(Context &ctx) {
     // __indirect_function_table
     {
         size += get_varuint32_size(ctx.__indirect_function_table.flags);
-        // Starts from index=1
-        WasmInitExpr offset = int32_const(1);
+        WasmInitExpr offset = int32_const(kTableBase);
         size += get_init_expr_size(ctx, offset);
-        size +=
-            get_varuint32_size(ctx.__indirect_function_table.elements.size());
-        for (auto &elem : ctx.__indirect_function_table.elements) {
-            size += get_varuint32_size(elem->index);
-        }
+        std::vector<Symbol *> &elems = ctx.__indirect_function_table.elements;
+        size += get_varuint32_size(elems.size());
+        elements.compute(elems.size(), [&](size_t i) {
+            return get_varuint32_size(elems[i]->index);
+        });
+        size += elements.size;
     }
 
     loc.content_size = size;
@@ -430,13 +492,13 @@ void ElemSection::copy_buf(Context &ctx) {
     // __indirect_function_table
     {
         write_varuint32(buf, ctx.__indirect_function_table.flags);
-        // Starts from index=1
-        WasmInitExpr offset = int32_const(1);
+        WasmInitExpr offset = int32_const(kTableBase);
         write_init_expr(ctx, buf, offset);
-        write_varuint32(buf, ctx.__indirect_function_table.elements.size());
-        for (auto &elem : ctx.__indirect_function_table.elements) {
-            write_varuint32(buf, elem->index);
-        }
+        std::vector<Symbol *> &elems = ctx.__indirect_function_table.elements;
+        write_varuint32(buf, elems.size());
+        elements.write(buf, [&](size_t i, u8 *&p) {
+            write_varuint32(p, elems[i]->index);
+        });
     }
 
     ASSERT(buf == ctx.buf + loc.offset + loc.size);
@@ -467,14 +529,22 @@ u64 CodeSection::compute_section_size(Context &ctx) {
     u64 size = 0;
     size += get_varuint32_size(ctx.functions.size()); // number of code
 
-    for (auto f : ctx.functions) {
-        Debug(ctx) << "computing code size for " << f->name << " ("
-                   << f->ifrag->get_size() << " bytes)";
-        f->ifrag->out_size_offset = size;
-        size += get_varuint32_size(f->ifrag->get_size());
-        f->ifrag->out_offset = size;
-        size += f->ifrag->get_size();
-    }
+    // Each body is preceded by its size.
+    bodies.compute(ctx.functions.size(), [&](size_t i) {
+        u64 body_size = ctx.functions[i]->ifrag->get_size();
+        return get_varuint32_size(body_size) + body_size;
+    });
+
+    tbb::parallel_for((size_t)0, ctx.functions.size(), [&](size_t i) {
+        InputFragment *ifrag = ctx.functions[i]->ifrag;
+        ifrag->out_size_offset = size + bodies.offsets[i];
+        ifrag->out_offset = ifrag->out_size_offset +
+                            get_varuint32_size(ifrag->get_size());
+        Debug(ctx, DEBUG_LAYOUT) << "computing code size for "
+                                 << ctx.functions[i]->name << " ("
+                                 << ifrag->get_size() << " bytes)";
+    });
+    size += bodies.size;
     loc.content_size = size;
     finalize_section_size_common(size);
     return size;
@@ -556,19 +626,15 @@ void DataSection::copy_buf(Context &ctx) {
             write_init_expr(ctx, buf, e);
             write_varuint32(buf, seg.get_size());
             u8 *const first_frag_start = buf;
-            for (auto &[name, p] : seg.get_ifrag_map()) {
-                auto [frag, offset] = p;
-                frag->write_to(ctx, first_frag_start + offset);
-            }
+            for (InputFragment *frag : seg.get_ifrags())
+                frag->write_to(ctx, first_frag_start + frag->seg_offset);
             buf += seg.get_size();
         } break;
         case WASM_DATA_SEGMENT_IS_PASSIVE: {
             write_varuint32(buf, seg.get_size());
             u8 *const first_frag_start = buf;
-            for (auto &[name, p] : seg.get_ifrag_map()) {
-                auto [frag, offset] = p;
-                frag->write_to(ctx, first_frag_start + offset);
-            }
+            for (InputFragment *frag : seg.get_ifrags())
+                frag->write_to(ctx, first_frag_start + frag->seg_offset);
             buf += seg.get_size();
         } break;
         case WASM_DATA_SEGMENT_HAS_MEMINDEX: {
@@ -577,10 +643,8 @@ void DataSection::copy_buf(Context &ctx) {
             write_init_expr(ctx, buf, e);
             write_varuint32(buf, seg.get_size());
             u8 *const first_frag_start = buf;
-            for (auto &[name, p] : seg.get_ifrag_map()) {
-                auto [frag, offset] = p;
-                frag->write_to(ctx, first_frag_start + offset);
-            }
+            for (InputFragment *frag : seg.get_ifrags())
+                frag->write_to(ctx, first_frag_start + frag->seg_offset);
             buf += seg.get_size();
         } break;
         }
@@ -588,13 +652,16 @@ void DataSection::copy_buf(Context &ctx) {
 }
 
 void DataSection::apply_reloc(Context &ctx) {
-    /*
-    tbb::parallel_for_each(ctx.data_symbols, [&](Symbol *sym) {
-        u64 osec_content_file_offset =
-            this->loc.offset + (this->loc.size - this->loc.content_size);
-        sym->isec->apply_reloc(ctx, osec_content_file_offset);
+    u8 *content_beg =
+        ctx.buf + this->loc.offset + (this->loc.size - this->loc.content_size);
+    tbb::parallel_for_each(ctx.segments, [&](auto &kv) {
+        OutputSegment &seg = kv.second;
+        u8 *seg_buf = content_beg + seg.out_offset;
+        u32 seg_va = seg.get_virtual_address();
+        tbb::parallel_for_each(seg.get_ifrags(), [&](InputFragment *frag) {
+            frag->apply_data_reloc(ctx, seg_buf, seg_va);
+        });
     });
-    */
 }
 
 // TODO: names should not be linking names but debug names
@@ -606,12 +673,12 @@ u64 NameSection::compute_section_size(Context &ctx) {
     size++; // function subsec kind
     function_subsec_size = 0;
     function_subsec_size += get_varuint32_size(ctx.functions.size());
-    for (u32 i = 0; i < ctx.functions.size(); i++) {
-        Symbol *sym = ctx.functions[i];
+    function_names.compute(ctx.functions.size(), [&](size_t i) {
         u32 index = ctx.import_functions.size() + i;
-        function_subsec_size += get_varuint32_size(index);
-        function_subsec_size += get_name_size(sym->name);
-    }
+        return get_varuint32_size(index) +
+               get_name_size(ctx.functions[i]->name);
+    });
+    function_subsec_size += function_names.size;
     size += get_varuint32_size(function_subsec_size);
     size += function_subsec_size;
 
@@ -619,12 +686,11 @@ u64 NameSection::compute_section_size(Context &ctx) {
     size++; // global subsec kind
     global_subsec_size = 0;
     global_subsec_size += get_varuint32_size(ctx.globals.size());
-    for (u32 i = 0; i < ctx.globals.size(); i++) {
-        Symbol *sym = ctx.globals[i];
+    global_names.compute(ctx.globals.size(), [&](size_t i) {
         u32 index = ctx.import_globals.size() + i;
-        global_subsec_size += get_varuint32_size(index);
-        global_subsec_size += get_name_size(sym->name);
-    }
+        return get_varuint32_size(index) + get_name_size(ctx.globals[i]->name);
+    });
+    global_subsec_size += global_names.size;
     size += get_varuint32_size(global_subsec_size);
     size += global_subsec_size;
 
@@ -651,12 +717,10 @@ void NameSection::copy_buf(Context &ctx) {
     write_varuint32(buf, function_subsec_size);
     // function subsec data
     write_varuint32(buf, ctx.functions.size());
-    for (u32 i = 0; i < ctx.functions.size(); i++) {
-        Symbol *sym = ctx.functions[i];
-        u32 index = ctx.import_functions.size() + i;
-        write_varint32(buf, index);
-        write_name(buf, sym->name);
-    }
+    function_names.write(buf, [&](size_t i, u8 *&p) {
+        write_varuint32(p, ctx.import_functions.size() + i);
+        write_name(p, ctx.functions[i]->name);
+    });
 
     // global subsec kind
     write_byte(buf, WASM_NAMES_GLOBAL);
@@ -664,12 +728,10 @@ void NameSection::copy_buf(Context &ctx) {
     write_varuint32(buf, global_subsec_size);
     // global subsec data
     write_varuint32(buf, ctx.globals.size());
-    for (u32 i = 0; i < ctx.globals.size(); i++) {
-        Symbol *sym = ctx.globals[i];
-        u32 index = ctx.import_globals.size() + i;
-        write_varint32(buf, index);
-        write_name(buf, sym->name);
-    }
+    global_names.write(buf, [&](size_t i, u8 *&p) {
+        write_varuint32(p, ctx.import_globals.size() + i);
+        write_name(p, ctx.globals[i]->name);
+    });
 
     ASSERT(buf == ctx.buf + loc.offset + loc.size);
 }
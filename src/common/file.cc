@@ -1,8 +1,19 @@
 #include "common/file.h"
+#include <atomic>
+#include <cstdio>
 #include <fcntl.h>
+#include <unistd.h>
 
 namespace xld {
 
+i64 get_mtime(const struct stat &st) {
+#ifdef __APPLE__
+    return st.st_mtimespec.tv_sec * 1000000000LL + st.st_mtimespec.tv_nsec;
+#else
+    return st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#endif
+}
+
 MappedFile *open_file_impl(const std::string &path, std::string &error) {
     i64 fd = ::open(path.c_str(), O_RDONLY);
     if (fd == -1) {
@@ -18,6 +29,7 @@ MappedFile *open_file_impl(const std::string &path, std::string &error) {
     MappedFile *mf = new MappedFile;
     mf->name = path;
     mf->size = st.st_size;
+    mf->mtime = get_mtime(st);
 
     if (st.st_size > 0) {
         mf->data = (u8 *)mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE,
@@ -30,4 +42,24 @@ MappedFile *open_file_impl(const std::string &path, std::string &error) {
     return mf;
 }
 
+bool write_file_atomic(const std::string &path, std::span<const u8> data) {
+    static std::atomic<i64> counter;
+    std::string tmp = path + ".tmp" + std::to_string(getpid()) + "." +
+                      std::to_string(counter++);
+
+    FILE *out = fopen(tmp.c_str(), "wb");
+    if (!out)
+        return false;
+    bool ok = fwrite(data.data(), 1, data.size(), out) == data.size();
+    if (fclose(out) != 0)
+        ok = false;
+    if (ok && rename(tmp.c_str(), path.c_str()) == 0)
+        return true;
+
+    int saved = errno;
+    unlink(tmp.c_str());
+    errno = saved;
+    return false;
+}
+
 } // namespace xld
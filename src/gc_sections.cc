@@ -0,0 +1,120 @@
+// This file implements --gc-sections, which removes functions, globals and
+// data segments that are not reachable from the roots.
+//
+// The unit of removal is an InputFragment (a function body or a data
+// segment); globals have no fragment, so their liveness is tracked by
+// their Symbol. Roots are exported symbols, symbols with the NO_STRIP flag,
+// init functions and linker-synthesized symbols. Edges are relocations:
+// a live fragment keeps alive every symbol its relocations refer to.
+//
+// Marking is a parallel graph traversal. Each newly reached fragment is
+// handed to TBB as a new work item, and an atomic flag on the fragment
+// makes sure it is visited only once. Fragments already killed by COMDAT
+// elimination are never visited, so they stay dead.
+
+#include "common/log.h"
+#include "oneapi/tbb/concurrent_vector.h"
+#include "oneapi/tbb/parallel_for_each.h"
+#include "pass.h"
+#include "xld.h"
+
+namespace xld::wasm {
+
+using Feeder = tbb::feeder<InputFragment *>;
+
+static bool is_root(Context &ctx, ObjectFile *obj, WasmSymbol &wsym,
+                    Symbol *sym) {
+    // Linker-synthesized symbols live in the file without a MappedFile.
+    if (!obj->mf)
+        return true;
+    if (wsym.is_exported() || (wsym.info.flags & WASM_SYMBOL_NO_STRIP))
+        return true;
+    if (wsym.info.init_func_priority.has_value())
+        return true;
+    return !wsym.is_binding_local() && should_export_symbol(ctx, sym);
+}
+
+static void mark_symbol(Symbol *sym, Feeder *feeder,
+                        tbb::concurrent_vector<InputFragment *> *roots) {
+    sym->is_alive = true;
+    InputFragment *frag = sym->ifrag;
+    if (frag && frag->is_alive && !frag->is_visited.exchange(true)) {
+        if (feeder)
+            feeder->add(frag);
+        else
+            roots->push_back(frag);
+    }
+}
+
+static void visit(InputFragment *frag, Feeder &feeder) {
+    for (WasmRelocation &reloc : frag->relocs) {
+        // The index of this relocation is a type index, not a symbol index.
+        if (reloc.type == R_WASM_TYPE_INDEX_LEB)
+            continue;
+        mark_symbol(frag->obj->syms[reloc.index], &feeder, nullptr);
+    }
+}
+
+static void print_gc_sections(Context &ctx) {
+    for (InputFile *file : ctx.files) {
+        ObjectFile *obj = static_cast<ObjectFile *>(file);
+
+        for (u32 i = 0; i < obj->code_ifrags.size(); i++)
+            if (obj->code_ifrags[i]->is_alive &&
+                !obj->code_ifrags[i]->is_visited)
+                SyncOut(ctx) << "removing unused section " << obj->filename
+                             << ":(" << obj->functions[i].symbol_name << ")";
+
+        for (u32 i = 0; i < obj->data_ifrags.size(); i++)
+            if (obj->data_ifrags[i]->is_alive &&
+                !obj->data_ifrags[i]->is_visited)
+                SyncOut(ctx) << "removing unused section " << obj->filename
+                             << ":(" << obj->data_segments[i].name << ")";
+
+        for (u32 i = 0; i < obj->symbols.size(); i++) {
+            WasmSymbol &wsym = obj->symbols[i];
+            Symbol *sym = obj->syms[i];
+            if (wsym.is_type_global() && wsym.is_defined() &&
+                sym->file == obj && !sym->is_alive)
+                SyncOut(ctx) << "removing unused section " << obj->filename
+                             << ":(" << wsym.info.name << ")";
+        }
+    }
+}
+
+void gc_sections(Context &ctx) {
+    Debug(ctx, DEBUG_SYMBOL) << "Collecting unused sections";
+
+    tbb::concurrent_vector<InputFragment *> roots;
+    tbb::parallel_for_each(ctx.files, [&](InputFile *file) {
+        ObjectFile *obj = static_cast<ObjectFile *>(file);
+        for (u32 i = 0; i < obj->symbols.size(); i++) {
+            WasmSymbol &wsym = obj->symbols[i];
+            Symbol *sym = obj->syms[i];
+            if (wsym.is_defined() && sym->file == obj &&
+                is_root(ctx, obj, wsym, sym))
+                mark_symbol(sym, nullptr, &roots);
+        }
+    });
+
+    tbb::parallel_for_each(roots, [&](InputFragment *frag, Feeder &feeder) {
+        visit(frag, feeder);
+    });
+
+    if (ctx.arg.print_gc_sections)
+        print_gc_sections(ctx);
+
+    // Sweep. Everything starts out alive so that the rest of the linker
+    // does not have to care whether --gc-sections is given.
+    tbb::parallel_for_each(ctx.files, [&](InputFile *file) {
+        ObjectFile *obj = static_cast<ObjectFile *>(file);
+        for (InputFragment *frag : obj->code_ifrags)
+            if (!frag->is_visited)
+                frag->is_alive = false;
+        for (InputFragment *frag : obj->data_ifrags)
+            if (!frag->is_visited)
+                frag->is_alive = false;
+    });
+}
+
+} // namespace xld::wasm
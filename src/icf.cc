@@ -0,0 +1,275 @@
+// This file implements Identical Code Folding (--icf), which merges
+// function bodies that are identical and whose relocations refer to
+// equivalent targets.
+//
+// Two functions calling each other (or themselves) cannot be compared by
+// looking at their bodies alone, so this is done the way mold does it:
+// each function first gets a digest of everything except the functions
+// it refers to, and then digests are refined in rounds by mixing in the
+// current digests of the referenced functions. When a round does not
+// split any class further, functions with the same digest are considered
+// identical. Each round is computed in parallel from the previous one.
+//
+// Members of a class are folded into the member which comes first on the
+// command line. A folded fragment is killed and records its leader, and
+// symbols defined by it get the leader's function index.
+//
+// With --icf=safe, functions whose address is taken (i.e. that are put
+// into the indirect function table) are not folded, so that distinct
+// functions keep distinct table entries.
+
+#include "common/log.h"
+#include "oneapi/tbb/parallel_for.h"
+#include "oneapi/tbb/parallel_for_each.h"
+#include "pass.h"
+#include "xld.h"
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace xld::wasm {
+
+namespace {
+struct Leaf {
+    ObjectFile *obj;
+    InputFragment *ifrag;
+    const WasmSignature *sig;
+};
+} // namespace
+
+// Maps a foldable function to its position in the list of leaves
+using LeafIndex = std::unordered_map<InputFragment *, i64>;
+
+static bool is_table_index_reloc(u8 type) {
+    return type == R_WASM_TABLE_INDEX_SLEB || type == R_WASM_TABLE_INDEX_I32 ||
+           type == R_WASM_TABLE_INDEX_SLEB64 ||
+           type == R_WASM_TABLE_INDEX_I64 ||
+           type == R_WASM_TABLE_INDEX_REL_SLEB ||
+           type == R_WASM_TABLE_INDEX_REL_SLEB64;
+}
+
+static bool is_equal_sig(const WasmSignature &a, const WasmSignature &b) {
+    return a.params == b.params && a.returns == b.returns;
+}
+
+// Returns functions that cannot be folded under --icf=safe.
+static std::unordered_set<InputFragment *>
+get_address_taken(Context &ctx) {
+    tbb::concurrent_vector<InputFragment *> vec;
+    tbb::parallel_for_each(ctx.files, [&](InputFile *file) {
+        ObjectFile *obj = static_cast<ObjectFile *>(file);
+        auto scan = [&](InputFragment *ifrag) {
+            if (!ifrag->is_alive)
+                return;
+            for (WasmRelocation &reloc : ifrag->relocs)
+                if (is_table_index_reloc(reloc.type))
+                    if (InputFragment *target = obj->syms[reloc.index]->ifrag)
+                        vec.push_back(target);
+        };
+        for (InputFragment *ifrag : obj->code_ifrags)
+            scan(ifrag);
+        for (InputFragment *ifrag : obj->data_ifrags)
+            scan(ifrag);
+    });
+    return {vec.begin(), vec.end()};
+}
+
+// Collects foldable functions in command-line order. Only bodies that are
+// going to be emitted are collected, so that every fold class is led by
+// a function in the output. For example, a weak definition that lost to
+// a strong one is still alive but never emitted.
+static std::vector<Leaf> collect_leaves(Context &ctx) {
+    std::unordered_set<InputFragment *> address_taken;
+    if (!ctx.arg.icf_all)
+        address_taken = get_address_taken(ctx);
+
+    std::vector<Leaf> leaves;
+    for (InputFile *file : ctx.files) {
+        ObjectFile *obj = static_cast<ObjectFile *>(file);
+        // Skip the internal file. Its bodies are synthesized later.
+        if (!obj->mf)
+            continue;
+
+        // Bodies defined by a symbol which won symbol resolution
+        std::unordered_set<InputFragment *> emitted;
+        for (u32 i = 0; i < obj->symbols.size(); i++) {
+            WasmSymbol &wsym = obj->symbols[i];
+            Symbol *sym = obj->syms[i];
+            if (wsym.is_type_function() && wsym.is_defined() &&
+                sym->file == obj && sym->ifrag)
+                emitted.insert(sym->ifrag);
+        }
+
+        for (u32 i = 0; i < obj->code_ifrags.size(); i++) {
+            InputFragment *ifrag = obj->code_ifrags[i];
+            if (!ifrag->is_alive || !emitted.contains(ifrag) ||
+                address_taken.contains(ifrag))
+                continue;
+            u32 sig_index = obj->functions[i].sig_index;
+            leaves.push_back({obj, ifrag, &obj->signatures[sig_index]});
+        }
+    }
+    return leaves;
+}
+
+// Returns the index of the leaf a relocation refers to, or -1 if it does
+// not refer to a foldable function.
+static i64 get_edge(Leaf &leaf, WasmRelocation &reloc,
+                    const LeafIndex &leaf_index) {
+    if (reloc.type == R_WASM_TYPE_INDEX_LEB)
+        return -1;
+    InputFragment *target = leaf.obj->syms[reloc.index]->ifrag;
+    if (!target)
+        return -1;
+    auto it = leaf_index.find(target);
+    return it == leaf_index.end() ? -1 : it->second;
+}
+
+template <typename T>
+static void append(std::string &buf, const T &val) {
+    buf.append((const char *)&val, sizeof(val));
+}
+
+// Computes the digest of everything but the referenced functions.
+static u64 get_initial_digest(Leaf &leaf, const LeafIndex &leaf_index) {
+    std::string buf;
+    append(buf, leaf.sig->params.size());
+    buf.append(leaf.sig->params.begin(), leaf.sig->params.end());
+    buf.append(leaf.sig->returns.begin(), leaf.sig->returns.end());
+    append(buf, leaf.ifrag->get_size());
+    buf.append(leaf.ifrag->span.begin(), leaf.ifrag->span.end());
+
+    for (WasmRelocation &reloc : leaf.ifrag->relocs) {
+        append(buf, reloc.type);
+        append(buf, reloc.offset - leaf.ifrag->in_offset);
+        append(buf, reloc.addend);
+
+        if (reloc.type == R_WASM_TYPE_INDEX_LEB) {
+            const WasmSignature &sig = leaf.obj->signatures[reloc.index];
+            append(buf, sig.params.size());
+            buf.append(sig.params.begin(), sig.params.end());
+            buf.append(sig.returns.begin(), sig.returns.end());
+        } else if (get_edge(leaf, reloc, leaf_index) == -1) {
+            // Any other target must be the very same symbol. Pointer
+            // values are not stable across runs, but they are only
+            // compared for equality.
+            append(buf, leaf.obj->syms[reloc.index]);
+        }
+    }
+    return hash_string(buf);
+}
+
+// Compares two functions whose digests matched. This catches digest
+// collisions; referenced functions are compared by their final digests.
+static bool is_equal(Leaf &a, Leaf &b, const std::vector<u64> &digests,
+                     const LeafIndex &leaf_index) {
+    if (!is_equal_sig(*a.sig, *b.sig))
+        return false;
+    if (a.ifrag->get_size() != b.ifrag->get_size() ||
+        a.ifrag->relocs.size() != b.ifrag->relocs.size())
+        return false;
+    if (!std::equal(a.ifrag->span.begin(), a.ifrag->span.end(),
+                    b.ifrag->span.begin()))
+        return false;
+
+    for (u32 i = 0; i < a.ifrag->relocs.size(); i++) {
+        WasmRelocation &ra = a.ifrag->relocs[i];
+        WasmRelocation &rb = b.ifrag->relocs[i];
+        if (ra.type != rb.type || ra.addend != rb.addend ||
+            ra.offset - a.ifrag->in_offset != rb.offset - b.ifrag->in_offset)
+            return false;
+
+        if (ra.type == R_WASM_TYPE_INDEX_LEB) {
+            if (!is_equal_sig(a.obj->signatures[ra.index],
+                              b.obj->signatures[rb.index]))
+                return false;
+            continue;
+        }
+
+        i64 ea = get_edge(a, ra, leaf_index);
+        i64 eb = get_edge(b, rb, leaf_index);
+        if (ea == -1 || eb == -1) {
+            if (a.obj->syms[ra.index] != b.obj->syms[rb.index])
+                return false;
+        } else if (digests[ea] != digests[eb]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static i64 count_classes(std::vector<u64> digests) {
+    std::sort(digests.begin(), digests.end());
+    return std::unique(digests.begin(), digests.end()) - digests.begin();
+}
+
+void icf_sections(Context &ctx) {
+    std::vector<Leaf> leaves = collect_leaves(ctx);
+    if (leaves.empty())
+        return;
+
+    LeafIndex leaf_index;
+    for (i64 i = 0; i < (i64)leaves.size(); i++)
+        leaf_index[leaves[i].ifrag] = i;
+
+    // Compute initial digests and edges to other foldable functions
+    std::vector<u64> digests(leaves.size());
+    std::vector<std::vector<i64>> edges(leaves.size());
+    tbb::parallel_for((i64)0, (i64)leaves.size(), [&](i64 i) {
+        digests[i] = get_initial_digest(leaves[i], leaf_index);
+        for (WasmRelocation &reloc : leaves[i].ifrag->relocs) {
+            i64 e = get_edge(leaves[i], reloc, leaf_index);
+            if (e != -1)
+                edges[i].push_back(e);
+        }
+    });
+    const std::vector<u64> initial = digests;
+
+    // Refine digests until the number of classes stops growing
+    i64 num_classes = count_classes(digests);
+    for (i64 round = 1;; round++) {
+        std::vector<u64> next(leaves.size());
+        tbb::parallel_for((i64)0, (i64)leaves.size(), [&](i64 i) {
+            std::string buf;
+            append(buf, initial[i]);
+            for (i64 e : edges[i])
+                append(buf, digests[e]);
+            next[i] = hash_string(buf);
+        });
+        digests = std::move(next);
+
+        i64 n = count_classes(digests);
+        Debug(ctx, DEBUG_LAYOUT) << "icf: round " << round << ": " << n
+                                 << " classes";
+        if (n == num_classes)
+            break;
+        num_classes = n;
+    }
+
+    // Fold each function into the first function with the same digest
+    // that it is equal to. Functions whose digests collide without being
+    // equal each lead a class of their own.
+    std::unordered_map<u64, std::vector<i64>> leaders;
+    i64 num_folded = 0;
+    for (i64 i = 0; i < (i64)leaves.size(); i++) {
+        std::vector<i64> &candidates = leaders[digests[i]];
+        auto it = std::find_if(candidates.begin(), candidates.end(),
+                               [&](i64 j) {
+                                   return is_equal(leaves[j], leaves[i],
+                                                   digests, leaf_index);
+                               });
+        if (it == candidates.end()) {
+            candidates.push_back(i);
+            continue;
+        }
+
+        leaves[i].ifrag->leader = leaves[*it].ifrag;
+        leaves[i].ifrag->is_alive = false;
+        num_folded++;
+    }
+
+    Debug(ctx, DEBUG_LAYOUT) << "icf: folded " << num_folded << " of "
+                             << leaves.size() << " functions";
+}
+
+} // namespace xld::wasm
@@ -6,88 +6,20 @@
 
 namespace xld::wasm {
 
-#define WASM_RELOC(x, y)                                                       \
-    case (x):                                                                  \
-        return (#x);
-
-static std::string_view get_reloc_type_name(u8 type) {
-    switch (type) {
-#include "wasm/wasm_relocs.def"
-    default:
-        return "<unknown>";
-    }
-}
-
-#undef WASM_RELOC
-
 void InputFragment::write_to(Context &ctx, u8 *buf) {
     memcpy(buf, span.data(), get_size());
 }
 
 u64 InputFragment::get_size() { return span.size(); }
 
-void InputFragment::apply_reloc(Context &ctx, u64 osec_content_file_offset) {
-    // https://github.com/WebAssembly/tool-conventions/blob/main/Linking.md
-    // Note that for all relocation types, the bytes being relocated:
-    //   from offset to offset + 5 for LEB/SLEB relocations;
-    //   from offset to offset + 10 for LEB64/SLEB64 relocations;
-    //   from offset to offset + 4 for I32 relocations;
-    //   or from offset to offset + 8 for I64;
-    //
-    // For R_WASM_MEMORY_ADDR_*, R_WASM_FUNCTION_OFFSET_I32, and
-    // R_WASM_SECTION_OFFSET_I32 relocations (and their 64-bit counterparts)
-    // the following field is additionally present:
-    //    addend varint32: addend to add to the address
-    u8 *frag_base = ctx.buf + osec_content_file_offset + out_offset;
-    for (WasmRelocation &reloc : relocs) {
-        u8 *reloc_loc = frag_base + (reloc.offset - in_offset);
-
-        switch (reloc.type) {
-        case R_WASM_FUNCTION_INDEX_LEB: {
-            std::string &name = this->obj->symbols[reloc.index].info.name;
-            Symbol *sym = get_symbol(ctx, name);
-            u32 val = sym->index;
-            encode_uleb128(val, reloc_loc, 5);
-        } break;
-        case R_WASM_GLOBAL_INDEX_LEB: {
-            std::string &name = this->obj->symbols[reloc.index].info.name;
-            Symbol *sym = get_symbol(ctx, name);
-            u32 val = sym->index;
-            encode_uleb128(val, reloc_loc, 5);
-        } break;
-        case R_WASM_MEMORY_ADDR_LEB: {
-            std::string &name = this->obj->symbols[reloc.index].info.name;
-            Symbol *sym = get_symbol(ctx, name);
-            u32 val = sym->virtual_address + reloc.addend;
-            encode_uleb128(val, reloc_loc, 5);
-        } break;
-        case R_WASM_TYPE_INDEX_LEB: {
-            std::string &name = this->obj->symbols[reloc.index].info.name;
-            Symbol *sym = get_symbol(ctx, name);
-            u32 val = sym->sig_index;
-            encode_uleb128(val, reloc_loc, 5);
-        } break;
-        default:
-            Error(ctx) << "TODO: Unknown reloc type: "
-                       << get_reloc_type_name(reloc.type);
-        }
-
-        std::string &name = this->obj->symbols[reloc.index].info.name;
-        Symbol &sym = *get_symbol(ctx, name);
-        Debug(ctx) << "- reloc for symbol: " << sym.name << " ("
-                   << get_reloc_type_name(reloc.type) << ")";
-    }
-}
-
 u64 InputSection::get_size() { return span.size(); }
 
 void InputSection::write_to(Context &ctx, u8 *buf) {
-    Debug(ctx) << "writing section: " << name << " " << obj->filename;
+    Debug(ctx, DEBUG_OUTPUT) << "writing section: " << name << " "
+                             << obj->filename;
     memcpy(buf, span.data(), get_size());
 }
 
-void InputSection::apply_reloc(Context &ctx, u64 osec_content_file_offset) {}
-
 InputFile::InputFile(Context &ctx, const std::string &filename, MappedFile *mf)
     : mf(mf), filename(filename) {
     if (!mf)
@@ -194,8 +126,9 @@ static void override_symbol(Context &ctx, Symbol *sym, ObjectFile *file,
     sym->elem_index = wsym.info.value.element_index;
     if (wsym.is_type_function() && file->is_defined_function(sym->elem_index))
         sym->ifrag = file->get_function_code(sym->elem_index);
-    if (wsym.is_type_data())
-        sym->ifrag = file->data_ifrags[sym->elem_index];
+    if (wsym.is_type_data() && wsym.is_defined() &&
+        !(wsym.info.flags & WASM_SYMBOL_ABSOLUTE))
+        sym->ifrag = file->data_ifrags[wsym.info.value.data_ref.segment];
 
     if (wsym.is_binding_weak())
         sym->binding = Symbol::Binding::Weak;
@@ -204,31 +137,54 @@ static void override_symbol(Context &ctx, Symbol *sym, ObjectFile *file,
 }
 
 void ObjectFile::resolve_symbols(Context &ctx) {
-    // Register all symbols in symtab to global symbol map
-    for (WasmSymbol &wsym : this->symbols) {
+    // Local symbols are not visible from other files, so each of them gets
+    // a Symbol owned by this file.
+    u32 num_locals = 0;
+    for (WasmSymbol &wsym : this->symbols)
         if (wsym.is_binding_local())
+            num_locals++;
+    this->local_syms = std::vector<Symbol>(num_locals);
+    this->syms.resize(this->symbols.size());
+
+    // Register all symbols in symtab to global symbol map
+    u32 local_index = 0;
+    for (u32 i = 0; i < this->symbols.size(); i++) {
+        WasmSymbol &wsym = this->symbols[i];
+        if (wsym.is_binding_local()) {
+            Symbol *sym = &this->local_syms[local_index++];
+            sym->name = wsym.info.name;
+            override_symbol(ctx, sym, this, wsym);
+            this->syms[i] = sym;
             continue;
+        }
 
         // Non-local symbol has a unique name.
         Symbol *sym = get_symbol(ctx, wsym.info.name);
+        this->syms[i] = sym;
         std::scoped_lock lock(sym->mu);
 
+        if (wsym.is_exported())
+            sym->is_exported = true;
+
         if (!sym->wsym.has_value()) {
             override_symbol(ctx, sym, this, wsym);
             continue;
         }
 
-        if (wsym.is_exported())
-            sym->is_exported = true;
-
         if (sym->is_defined() && sym->binding == Symbol::Binding::Global &&
             wsym.is_defined() && wsym.is_binding_global()) {
             Error(ctx) << "Duplicate strong symbol definition: "
                        << wsym.info.name;
         }
 
-        if (!sym->wsym.has_value() ||
-            get_rank(wsym) > get_rank(sym->wsym.value())) {
+        // Ties are broken by file priority so that the result does not
+        // depend on the order in which files are resolved. This also makes
+        // a weak definition in a COMDAT group resolve to the file that
+        // owns the group.
+        u32 rank = get_rank(wsym);
+        u32 cur_rank = get_rank(sym->wsym.value());
+        if (rank > cur_rank ||
+            (rank == cur_rank && this->priority < sym->file->priority)) {
             override_symbol(ctx, sym, this, wsym);
         }
     };
@@ -3,25 +3,67 @@
 #include "common/filetype.h"
 #include "common/mmap.h"
 #include "common/output_file.h"
+#include "linker.h"
 #include "pass.h"
 #include "xld.h"
+#include <charconv>
+#include <mutex>
 
 namespace xld::wasm {
 
-int linker_main(int argc, char **argv) {
-    Context ctx;
+// Parses a comma-separated list of subsystems given to --debug.
+static u32 parse_debug_kinds(Context &ctx, std::string_view list) {
+    u32 kinds = 0;
+    while (!list.empty()) {
+        size_t pos = list.find(',');
+        std::string_view name = list.substr(0, pos);
+        list = (pos == list.npos) ? "" : list.substr(pos + 1);
+
+        if (name == "all")
+            kinds |= DEBUG_ALL;
+        else if (name == "input")
+            kinds |= DEBUG_INPUT;
+        else if (name == "symbol")
+            kinds |= DEBUG_SYMBOL;
+        else if (name == "layout")
+            kinds |= DEBUG_LAYOUT;
+        else if (name == "reloc")
+            kinds |= DEBUG_RELOC;
+        else if (name == "output")
+            kinds |= DEBUG_OUTPUT;
+        else
+            Fatal(ctx) << "unknown --debug subsystem: " << name;
+    }
+    return kinds;
+}
 
-    i64 thread_count = get_default_thread_count();
-    Debug(ctx) << "thread_count: " << thread_count;
-    tbb::global_control tbb_cont(tbb::global_control::max_allowed_parallelism,
-                                 thread_count);
+// Parses the argument of --threads.
+static i64 parse_thread_count(Context &ctx, std::string_view arg) {
+    i64 n = 0;
+    auto [ptr, ec] = std::from_chars(arg.data(), arg.data() + arg.size(), n);
+    if (ec != std::errc() || ptr != arg.data() + arg.size() || n <= 0)
+        Fatal(ctx) << "invalid --threads argument: " << arg;
+    return n;
+}
 
-    // read files
+namespace {
+// An input file named on the command line, or a buffer given to Linker
+struct LinkInput {
+    std::string path;
+    MappedFile *mf = nullptr;
+};
+} // namespace
+
+// Parses the command line into ctx.arg and returns the input files.
+static std::vector<std::string> parse_args(Context &ctx, int argc,
+                                           char **argv) {
     std::vector<std::string> input_files;
     for (int i = 1; i < argc; i++) {
         std::string arg = argv[i];
         if (arg == "--export-all") {
             ctx.arg.export_all = true;
+        } else if (arg.starts_with("--export=")) {
+            ctx.arg.export_symbols.push_back(arg.substr(9));
         } else if (arg == "--allow-undefined") {
             ctx.arg.allow_undefined = true;
         } else if (arg == "-o") {
@@ -30,51 +72,122 @@ int linker_main(int argc, char **argv) {
             ctx.arg.output_file = argv[++i];
         } else if (arg == "--dump-input") {
             ctx.arg.dump_input = true;
+        } else if (arg == "--gc-sections") {
+            ctx.arg.gc_sections = true;
+        } else if (arg == "--no-gc-sections") {
+            ctx.arg.gc_sections = false;
+        } else if (arg == "--print-gc-sections") {
+            ctx.arg.print_gc_sections = true;
+        } else if (arg == "--icf=all") {
+            ctx.arg.icf = true;
+            ctx.arg.icf_all = true;
+        } else if (arg == "--icf=safe") {
+            ctx.arg.icf = true;
+            ctx.arg.icf_all = false;
+        } else if (arg == "--icf=none") {
+            ctx.arg.icf = false;
+        } else if (arg == "--compress-relocations") {
+            ctx.arg.compress_relocations = true;
+        } else if (arg == "--no-compress-relocations") {
+            ctx.arg.compress_relocations = false;
+        } else if (arg.starts_with("--icf=")) {
+            Fatal(ctx) << "unknown --icf argument: " << arg.substr(6);
+        } else if (arg.starts_with("--threads=")) {
+            ctx.arg.thread_count = parse_thread_count(ctx, arg.substr(10));
+        } else if (arg == "--no-threads") {
+            ctx.arg.thread_count = 1;
+        } else if (arg == "--cache-dir") {
+            if (i + 1 >= argc)
+                Fatal(ctx) << "missing argument to --cache-dir";
+            ctx.arg.cache_dir = argv[++i];
+        } else if (arg.starts_with("--cache-dir=")) {
+            ctx.arg.cache_dir = arg.substr(12);
+        } else if (arg == "--server") {
+            if (i + 1 >= argc)
+                Fatal(ctx) << "missing argument to --server";
+            ctx.arg.server = argv[++i];
+        } else if (arg.starts_with("--server=")) {
+            ctx.arg.server = arg.substr(9);
+        } else if (arg == "--connect") {
+            if (i + 1 >= argc)
+                Fatal(ctx) << "missing argument to --connect";
+            ctx.arg.connect = argv[++i];
+        } else if (arg.starts_with("--connect=")) {
+            ctx.arg.connect = arg.substr(10);
+        } else if (arg == "--batch") {
+            if (i + 1 >= argc)
+                Fatal(ctx) << "missing argument to --batch";
+            ctx.arg.batch = argv[++i];
+        } else if (arg.starts_with("--batch=")) {
+            ctx.arg.batch = arg.substr(8);
+        } else if (arg == "--index-archive") {
+            ctx.arg.index_archive = true;
+        } else if (arg == "--stats") {
+            ctx.arg.stats = true;
+        } else if (arg == "-v" || arg == "--verbose") {
+            ctx.arg.verbose = true;
+        } else if (arg.starts_with("--debug=")) {
+            ctx.arg.debug |= parse_debug_kinds(ctx, arg.substr(8));
         } else {
             std::string path = path_clean(argv[i]);
             input_files.push_back(path);
         }
     }
+    return input_files;
+}
 
-    if (input_files.empty())
-        Fatal(ctx) << "no input files";
+static void create_cache_dir(Context &ctx) {
+    std::error_code ec;
+    std::filesystem::create_directories(ctx.arg.cache_dir, ec);
+    if (ec)
+        Fatal(ctx) << "cannot create cache directory " << ctx.arg.cache_dir
+                   << ": " << ec.message();
+}
 
-    tbb::concurrent_vector<ObjectFile *> objs;
-    tbb::parallel_for_each(input_files, [&](auto &path) {
-        MappedFile *mf = must_open_file(ctx, path);
-        SyncOut(ctx) << "Open " << path << " (" << get_file_type(ctx, mf)
-                     << ")";
+// Links `inputs`. `get_output_buf` is called once the size of the output
+// is known, and returns a zero-filled buffer to write the output to.
+static void run_link(Context &ctx, std::vector<LinkInput> &inputs,
+                     const std::function<u8 *(u64)> &get_output_buf) {
+    // Object files are parsed right away. Archives are only indexed here;
+    // resolve_symbols() reads the members that are needed.
+    std::vector<ObjectFile *> objs(inputs.size());
+    std::vector<Archive *> archives(inputs.size());
+    tbb::parallel_for((size_t)0, inputs.size(), [&](size_t i) {
+        std::string &path = inputs[i].path;
+        MappedFile *mf = inputs[i].mf;
+        if (!mf)
+            mf = ctx.resident ? ctx.resident->open_file(ctx, path)
+                              : must_open_file(ctx, path);
+        if (ctx.arg.verbose)
+            SyncOut(ctx) << "Open " << path << " (" << get_file_type(ctx, mf)
+                         << ")";
         switch (get_file_type(ctx, mf)) {
         case FileType::WASM_OBJ: {
-            ObjectFile *obj = ObjectFile::create(ctx, path, mf);
-            obj->parse(ctx);
-            objs.push_back(obj);
-        } break;
-        case FileType::AR: {
-            for (MappedFile *f : read_archive_members(ctx, mf)) {
-                ObjectFile *obj = ObjectFile::create(ctx, f->name, f);
-                obj->parse(ctx);
-                objs.push_back(obj);
-            }
-        } break;
-        case FileType::THIN_AR: {
-            for (MappedFile *f : read_thin_archive_members(ctx, mf)) {
-                ObjectFile *obj = ObjectFile::create(ctx, f->name, f);
-                obj->parse(ctx);
-                objs.push_back(obj);
-            }
+            objs[i] = ObjectFile::create(ctx, path, mf);
+            objs[i]->parse(ctx);
         } break;
+        case FileType::AR:
+        case FileType::THIN_AR:
+            archives[i] = Archive::create(ctx, mf);
+            break;
         default:
             Fatal(ctx) << "unknown file type: " << path;
             break;
         }
     });
 
-    for (ObjectFile *obj : objs) {
-        if (ctx.arg.dump_input)
-            obj->dump(ctx);
-
-        ctx.files.push_back(obj);
+    // Priority 0 is reserved for the internal file. Each archive reserves
+    // a priority for every member, whether or not it is ever read.
+    i64 priority = 1;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        if (objs[i]) {
+            objs[i]->priority = priority++;
+            ctx.files.push_back(objs[i]);
+        } else {
+            archives[i]->priority = priority;
+            priority += archives[i]->index.members.size();
+            ctx.archives.push_back(archives[i]);
+        }
     }
 
     ctx.checkpoint();
@@ -85,20 +198,41 @@ int linker_main(int argc, char **argv) {
     // if (target is not relocatable)
     create_internal_file(ctx);
 
-    // - Determine the set of object files to extract from archives.
-    // - Remove redundant COMDAT sections (e.g. duplicate inline functions).
-    // - Finally, the actual symbol resolution.
     // - LTO, which requires preliminary symbol resolution before running
     //   and a follow-up re-resolution after the LTO objects are emitted.
 
-    // Resolve symbol definitions. Error if there are multiple definitons for a
+    // Resolve symbol definitions and extract archive members which define
+    // undefined symbols. Error if there are multiple definitons for a
     // single symbol.
     resolve_symbols(ctx);
 
+    // Remove redundant COMDAT sections (e.g. duplicate inline functions).
+    eliminate_comdats(ctx);
+
+    if (ctx.arg.dump_input)
+        for (InputFile *file : ctx.files)
+            if (file->mf)
+                static_cast<ObjectFile *>(file)->dump(ctx);
+
     check_undefined(ctx);
 
+    for (std::string_view name : ctx.arg.export_symbols) {
+        Symbol *sym = get_symbol(ctx, name);
+        if (!sym->is_defined())
+            Error(ctx) << "symbol not found: " << name;
+        sym->is_exported = true;
+    }
+
     ctx.checkpoint();
 
+    // Remove unreachable functions, globals and data segments
+    if (ctx.arg.gc_sections)
+        gc_sections(ctx);
+
+    // Merge identical functions
+    if (ctx.arg.icf)
+        icf_sections(ctx);
+
     // Create linker-synthesized sections
     create_synthetic_sections(ctx);
 
@@ -154,26 +288,189 @@ int linker_main(int argc, char **argv) {
     setup_indirect_functions(ctx);
     setup_memory(ctx);
 
+    // Re-encode relocated LEBs in function bodies with their minimal width
+    if (ctx.arg.compress_relocations)
+        compress_relocations(ctx);
+
     // Compute sizes of output sections while assigning offsets
     // within an output section to input sections.
     u64 size = compute_section_sizes(ctx);
     // At this point, both memory and file layouts are fixed.
 
+    ctx.buf = get_output_buf(size);
+
+    copy_chunks(ctx);
+    apply_reloc(ctx);
+}
+
+int linker_main(int argc, char **argv, ResidentInputs *resident) {
+    Context ctx;
+    ctx.resident = resident;
+    ctx.throw_on_fatal = (resident != nullptr);
+
+    std::vector<std::string> input_files = parse_args(ctx, argc, argv);
+
+    if (ctx.resident && (!ctx.arg.server.empty() ||
+                         !ctx.arg.connect.empty() || !ctx.arg.batch.empty()))
+        Fatal(ctx) << "--server, --connect and --batch cannot be used in a "
+                      "link run by a server or a batch";
+    if (!ctx.arg.connect.empty())
+        return run_client(ctx, argc, argv);
+
+    if (input_files.empty() && ctx.arg.server.empty() && ctx.arg.batch.empty())
+        Fatal(ctx) << "no input files";
+
+#ifdef NDEBUG
+    if (ctx.arg.debug)
+        Warn(ctx) << "--debug is ignored: debug messages are not compiled "
+                     "into release builds";
+#endif
+
+    // The thread limit is process-wide, so a link run by a server or a
+    // batch must not set it for the other links running at the same time.
+    std::optional<tbb::global_control> tbb_cont;
+    if (ctx.resident) {
+        if (ctx.arg.thread_count)
+            Warn(ctx) << "--threads is ignored in a link run by a server or "
+                         "a batch";
+    } else {
+        i64 thread_count = ctx.arg.thread_count;
+        if (thread_count == 0)
+            thread_count = get_default_thread_count();
+        if (ctx.arg.verbose)
+            SyncOut(ctx) << "thread_count: " << thread_count;
+        tbb_cont.emplace(tbb::global_control::max_allowed_parallelism,
+                         thread_count);
+    }
+
+    // Links sent to the server or listed in a batch run inside this call,
+    // so the thread count given here is an upper bound for all of them.
+    if (!ctx.arg.server.empty())
+        return run_server(ctx);
+    if (!ctx.arg.batch.empty())
+        return run_batch(ctx);
+
+    if (!ctx.arg.cache_dir.empty())
+        create_cache_dir(ctx);
+
+    if (ctx.arg.index_archive) {
+        tbb::parallel_for_each(input_files, [&](const std::string &path) {
+            Archive::write_index(ctx, must_open_file(ctx, path));
+        });
+        ctx.checkpoint();
+        return 0;
+    }
+
+    std::vector<LinkInput> inputs;
+    for (std::string &path : input_files)
+        inputs.push_back({path});
+
     // https://github.com/tamaroning/mold/blob/3df7c8e89c507865abe0fad4ff5355f4d328f78d/elf/main.cc#L637
     std::string filename{kDefaultFileName};
     if (!ctx.arg.output_file.empty())
         filename = ctx.arg.output_file;
-    auto output_file = OutputFile<Context>::open(ctx, filename, size, 0777);
-    ctx.buf = output_file->buf;
 
-    copy_chunks(ctx);
-    apply_reloc(ctx);
+    if (filename == "-") {
+        // Like lld, `-o -` writes the output to stdout.
+        std::vector<u8> buf;
+        run_link(ctx, inputs, [&](u64 size) {
+            buf.resize(size);
+            return buf.data();
+        });
+        if (fwrite(buf.data(), 1, buf.size(), stdout) != buf.size() ||
+            fflush(stdout))
+            Fatal(ctx) << "cannot write to stdout: " << errno_string();
+    } else {
+        std::unique_ptr<OutputFile<Context>> output_file;
+        run_link(ctx, inputs, [&](u64 size) {
+            output_file = OutputFile<Context>::open(ctx, filename, size, 0777);
+            return output_file->buf;
+        });
+        output_file->close(ctx);
+    }
 
-    output_file->close(ctx);
+    Debug(ctx, DEBUG_OUTPUT) << "Write to " << filename;
 
-    Debug(ctx) << "Write to " << filename;
+    if (ctx.arg.stats)
+        print_stats(ctx);
 
     return 0;
 }
 
+Linker::Linker(std::vector<std::string> args) : args(std::move(args)) {}
+
+void Linker::add_input(std::string name, std::span<const u8> data) {
+    inputs.push_back({std::move(name), data});
+}
+
+LinkResult Linker::link() {
+    std::vector<u8> output;
+    LinkResult result = link([&](u64 size) {
+        output.resize(size);
+        return output.data();
+    });
+    if (result.ok)
+        result.output = std::move(output);
+    return result;
+}
+
+LinkResult Linker::link(const std::function<u8 *(u64 size)> &sink) {
+    LinkResult result;
+    std::mutex mu;
+
+    Context ctx;
+    ctx.throw_on_fatal = true;
+    ctx.diagnostic_handler = [&](bool is_error, std::string msg) {
+        std::scoped_lock lock(mu);
+        result.diagnostics.push_back({is_error, std::move(msg)});
+    };
+
+    std::vector<char *> argv = {(char *)"xld"};
+    for (std::string &arg : args)
+        argv.push_back(arg.data());
+    argv.push_back(nullptr);
+
+    try {
+        std::vector<std::string> input_files =
+            parse_args(ctx, argv.size() - 1, argv.data());
+        if (!ctx.arg.server.empty() || !ctx.arg.connect.empty() ||
+            !ctx.arg.batch.empty() || ctx.arg.index_archive)
+            Fatal(ctx) << "--server, --connect, --batch and --index-archive "
+                          "cannot be used with the Linker API";
+        if (input_files.empty() && inputs.empty())
+            Fatal(ctx) << "no input files";
+
+        // The limit applies to the whole process, so it is only set if it
+        // was asked for.
+        std::optional<tbb::global_control> tbb_cont;
+        if (ctx.arg.thread_count)
+            tbb_cont.emplace(tbb::global_control::max_allowed_parallelism,
+                             ctx.arg.thread_count);
+
+        if (!ctx.arg.cache_dir.empty())
+            create_cache_dir(ctx);
+
+        std::vector<LinkInput> link_inputs;
+        for (std::string &path : input_files)
+            link_inputs.push_back({path});
+        for (Input &input : inputs)
+            link_inputs.push_back(
+                {input.name, MappedFile::wrap(ctx, input.name, input.data)});
+
+        run_link(ctx, link_inputs, [&](u64 size) {
+            u8 *buf = sink(size);
+            if (!buf)
+                Fatal(ctx) << "no output buffer";
+            memset(buf, 0, size);
+            return buf;
+        });
+
+        if (ctx.arg.stats)
+            print_stats(ctx);
+        result.ok = !ctx.has_error;
+    } catch (FatalError &) {
+    }
+    return result;
+}
+
 } // namespace xld::wasm
@@ -8,13 +8,13 @@ namespace xld::wasm {
 
 OutputSegment *OutputSegment::get_or_create(Context &ctx,
                                             const std::string_view &name) {
-    std::string_view name_;
-    if (name.starts_with(".data."))
-        name_ = ".data";
-    else if (name.starts_with(".bss."))
-        name_ = ".bss";
-    else
-        Fatal(ctx) << "Unknown segment name: " << name;
+    // Input segments are merged by their name prefix. Other names are kept
+    // as they are, as lld does.
+    std::string_view name_ = name;
+    for (std::string_view prefix : {".rodata", ".data", ".bss", ".tdata"})
+        if (name.starts_with(prefix) &&
+            (name.size() == prefix.size() || name[prefix.size()] == '.'))
+            name_ = prefix;
 
     auto it = ctx.segments.find(name_);
     if (it == ctx.segments.end()) {
@@ -29,15 +29,16 @@ OutputSegment *OutputSegment::get_or_create(Context &ctx,
 
 void OutputSegment::merge(Context &ctx, const WasmDataSegment &seg,
                           InputFragment *ifrag) {
-    if (ifrag_map.empty())
+    if (ifrags.empty())
         init_flags = seg.init_flags;
     else if (init_flags != seg.init_flags)
         Fatal(ctx) << "Incompatible init flags for segment: " << name;
 
-    size = align(size, seg.p2align);
-    p2align = std::max(size, seg.p2align);
+    size = align(size, 1 << seg.p2align);
+    p2align = std::max(p2align, seg.p2align);
 
-    ifrag_map.insert({seg.name, {ifrag, size}});
+    ifrag->seg_offset = size;
+    ifrags.push_back(ifrag);
     size += ifrag->get_size();
 }
 
@@ -0,0 +1,748 @@
+// This file implements the parse cache enabled by --cache-dir.
+//
+// Programs are relinked against the same large libraries over and over,
+// and their members are parsed from scratch every time. With a cache
+// directory, the state ObjectFile::parse() builds is saved to a file, and
+// a later link restores it from there if the input has not changed. The
+// link server keeps the same state in memory between links.
+//
+// A cache file is named after a hash of the input's name, size and
+// modification time. It records a hash of the input's contents, which is
+// checked before the entry is used, and a hash of its own payload, so a
+// truncated or stale entry is just a miss.
+//
+// Names, bodies and init expressions are views into the input file, so
+// they are saved as offsets into it. The few views that point elsewhere,
+// such as the names the parser gives to non-custom sections, are saved
+// inline and point into the mapped cache file after loading. Pointers
+// between the parsed structures are saved as indices. Structures with
+// padding or unions are saved field by field, so that a cache file
+// depends only on its input.
+
+#include "common/file.h"
+#include "common/system.h"
+#include "xld.h"
+#include <atomic>
+
+namespace xld::wasm {
+
+static constexpr char kCacheMagic[8] = {'X', 'L', 'D', 'C', 'A', 'C', 'H', 'E'};
+// Bump this whenever the layout of the payload changes.
+static constexpr u32 kCacheVersion = 2;
+
+namespace {
+struct CacheHeader {
+    char magic[8];
+    u32 version;
+    u32 reserved;
+    u64 input_size;
+    u64 input_hash;
+    u64 payload_hash;
+};
+
+class CacheWriter {
+  public:
+    CacheWriter(MappedFile *mf) : input(mf) {}
+
+    template <typename T>
+    void put(const T &val) {
+        static_assert(std::has_unique_object_representations_v<T>);
+        const u8 *p = (const u8 *)&val;
+        buf.insert(buf.end(), p, p + sizeof(T));
+    }
+
+    template <typename T>
+    void put_vec(const std::vector<T> &vec) {
+        static_assert(std::has_unique_object_representations_v<T>);
+        put<u32>(vec.size());
+        const u8 *p = (const u8 *)vec.data();
+        buf.insert(buf.end(), p, p + vec.size() * sizeof(T));
+    }
+
+    void put_span(std::span<const u8> span) {
+        const u8 *begin = input->data;
+        const u8 *end = begin + input->size;
+        if (begin <= span.data() && span.data() + span.size() <= end) {
+            put<u8>(0);
+            put<u32>(span.data() - begin);
+            put<u32>(span.size());
+        } else {
+            put<u8>(1);
+            put<u32>(span.size());
+            buf.insert(buf.end(), span.begin(), span.end());
+        }
+    }
+
+    void put_str(std::string_view str) {
+        put_span({(const u8 *)str.data(), str.size()});
+    }
+
+    void put_opt_str(const std::optional<std::string_view> &str) {
+        put<u8>(str.has_value());
+        if (str)
+            put_str(*str);
+    }
+
+    void put_limits(const WasmLimits &limits) {
+        put(limits.flags);
+        put(limits.minimum);
+        put(limits.maximum);
+    }
+
+    void put_relocs(const std::vector<WasmRelocation> &relocs) {
+        put<u32>(relocs.size());
+        for (const WasmRelocation &rel : relocs) {
+            put(rel.type);
+            put(rel.index);
+            put(rel.offset);
+            put(rel.addend);
+        }
+    }
+
+    // Only the member of the value the opcode uses is set.
+    void put_init_expr(const WasmInitExpr &expr) {
+        put(expr.extended);
+        put(expr.inst.opcode);
+        switch (expr.inst.opcode) {
+        case WASM_OPCODE_I32_CONST:
+            put(expr.inst.value.int32);
+            break;
+        case WASM_OPCODE_I64_CONST:
+            put(expr.inst.value.int64);
+            break;
+        case WASM_OPCODE_F32_CONST:
+            put(expr.inst.value.float32);
+            break;
+        case WASM_OPCODE_F64_CONST:
+            put(expr.inst.value.float64);
+            break;
+        case WASM_OPCODE_GLOBAL_GET:
+            put(expr.inst.value.global);
+            break;
+        }
+        put<u8>(expr.body.has_value());
+        if (expr.body)
+            put_span(*expr.body);
+    }
+
+    std::vector<u8> buf;
+
+  private:
+    MappedFile *input;
+};
+
+// Reads what CacheWriter wrote. Reads past the end or views outside the
+// input clear `ok` and return empty values instead of failing.
+class CacheReader {
+  public:
+    CacheReader(MappedFile *input, std::span<const u8> payload)
+        : input(input), p(payload.data()),
+          end(payload.data() + payload.size()) {}
+
+    template <typename T>
+    T get() {
+        static_assert(std::is_trivially_copyable_v<T>);
+        T val{};
+        if (end - p < (i64)sizeof(T)) {
+            ok = false;
+            return val;
+        }
+        memcpy(&val, p, sizeof(T));
+        p += sizeof(T);
+        return val;
+    }
+
+    template <typename T>
+    std::vector<T> get_vec() {
+        static_assert(std::is_trivially_copyable_v<T>);
+        u32 n = get<u32>();
+        if ((u64)(end - p) / sizeof(T) < n) {
+            ok = false;
+            return {};
+        }
+        std::vector<T> vec(n);
+        memcpy(vec.data(), p, n * sizeof(T));
+        p += n * sizeof(T);
+        return vec;
+    }
+
+    std::span<const u8> get_span() {
+        u8 inline_bytes = get<u8>();
+        if (inline_bytes) {
+            u32 len = get<u32>();
+            if (end - p < len) {
+                ok = false;
+                return {};
+            }
+            p += len;
+            return {p - len, len};
+        }
+
+        u32 offset = get<u32>();
+        u32 len = get<u32>();
+        if ((u64)offset + len > (u64)input->size) {
+            ok = false;
+            return {};
+        }
+        return {input->data + offset, len};
+    }
+
+    std::string_view get_str() {
+        std::span<const u8> span = get_span();
+        return {(const char *)span.data(), span.size()};
+    }
+
+    std::optional<std::string_view> get_opt_str() {
+        if (get<u8>())
+            return get_str();
+        return std::nullopt;
+    }
+
+    WasmLimits get_limits() {
+        WasmLimits limits{};
+        limits.flags = get<u8>();
+        limits.minimum = get<u64>();
+        limits.maximum = get<u64>();
+        return limits;
+    }
+
+    std::vector<WasmRelocation> get_relocs() {
+        constexpr u64 kRelocSize = sizeof(u8) + sizeof(u32) + sizeof(u64) +
+                                   sizeof(i64);
+        u32 n = get<u32>();
+        if ((u64)(end - p) / kRelocSize < n) {
+            ok = false;
+            return {};
+        }
+        std::vector<WasmRelocation> relocs(n);
+        for (WasmRelocation &rel : relocs) {
+            rel.type = get<u8>();
+            rel.index = get<u32>();
+            rel.offset = get<u64>();
+            rel.addend = get<i64>();
+        }
+        return relocs;
+    }
+
+    WasmInitExpr get_init_expr() {
+        WasmInitExpr expr;
+        expr.extended = get<u8>();
+        expr.inst = {};
+        expr.inst.opcode = get<u8>();
+        switch (expr.inst.opcode) {
+        case WASM_OPCODE_I32_CONST:
+            expr.inst.value.int32 = get<i32>();
+            break;
+        case WASM_OPCODE_I64_CONST:
+            expr.inst.value.int64 = get<i64>();
+            break;
+        case WASM_OPCODE_F32_CONST:
+            expr.inst.value.float32 = get<u32>();
+            break;
+        case WASM_OPCODE_F64_CONST:
+            expr.inst.value.float64 = get<u64>();
+            break;
+        case WASM_OPCODE_GLOBAL_GET:
+            expr.inst.value.global = get<u32>();
+            break;
+        }
+        if (get<u8>())
+            expr.body = get_span();
+        else
+            expr.body = std::nullopt;
+        return expr;
+    }
+
+    bool at_end() const { return p == end; }
+
+    bool ok = true;
+
+  private:
+    MappedFile *input;
+    const u8 *p;
+    const u8 *end;
+};
+} // namespace
+
+static std::string get_cache_path(Context &ctx, ObjectFile &obj) {
+    std::string key = obj.filename + '\0' + std::to_string(obj.mf->size) +
+                      '\0' + std::to_string(obj.mf->mtime);
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.cache",
+             (unsigned long long)hash_string(key));
+    return ctx.arg.cache_dir + "/" + name;
+}
+
+// Returns the index of the element of `vec` that `ptr` points into, or -1.
+template <typename T>
+static i32 index_of(const std::vector<T> &vec, const void *ptr) {
+    const u8 *begin = (const u8 *)vec.data();
+    const u8 *end = (const u8 *)(vec.data() + vec.size());
+    if (ptr < begin || end <= ptr)
+        return -1;
+    return ((const u8 *)ptr - begin) / sizeof(T);
+}
+
+std::vector<u8> ObjectFile::save_parse_state() {
+    CacheWriter w(mf);
+
+    w.put(num_imported_globals);
+    w.put(num_imported_functions);
+    w.put(num_imported_tables);
+    w.put(num_imported_memories);
+    w.put(data_count);
+    w.put(linking_data.version);
+    w.put_str(module_name);
+
+    w.put<u32>(signatures.size());
+    for (WasmSignature &sig : signatures) {
+        w.put_vec(sig.returns);
+        w.put_vec(sig.params);
+        w.put(sig.kind);
+        w.put(sig.state);
+    }
+
+    w.put<u32>(imports.size());
+    for (WasmImport &import : imports) {
+        w.put_str(import.module);
+        w.put_str(import.field);
+        w.put(import.kind);
+        switch (import.kind) {
+        case WASM_EXTERNAL_FUNCTION:
+            w.put(import.sig_index);
+            break;
+        case WASM_EXTERNAL_TABLE:
+            w.put(import.table.elem_type);
+            w.put_limits(import.table.limits);
+            break;
+        case WASM_EXTERNAL_MEMORY:
+            w.put_limits(import.memory);
+            break;
+        case WASM_EXTERNAL_GLOBAL:
+            w.put(import.global);
+            break;
+        }
+    }
+
+    w.put<u32>(functions.size());
+    for (WasmFunction &func : functions) {
+        w.put(func.index);
+        w.put(func.sig_index);
+        w.put_str(func.symbol_name);
+        w.put_opt_str(func.export_name);
+        w.put_str(func.debug_name);
+    }
+
+    w.put<u32>(memories.size());
+    for (WasmLimits &limits : memories)
+        w.put_limits(limits);
+
+    w.put<u32>(globals.size());
+    for (WasmGlobal &global : globals) {
+        w.put(global.type);
+        w.put_init_expr(global.init_expr);
+        w.put_str(global.symbol_name);
+    }
+
+    w.put<u32>(exports.size());
+    for (WasmExport &exp : exports) {
+        w.put_str(exp.name);
+        w.put(exp.kind);
+        w.put(exp.index);
+    }
+
+    w.put<u32>(elem_segments.size());
+    for (WasmElemSegment &seg : elem_segments) {
+        w.put(seg.flags);
+        w.put(seg.table_number);
+        w.put(seg.elem_kind);
+        w.put_init_expr(seg.offset);
+        w.put_vec(seg.functions);
+    }
+
+    w.put<u32>(data_segments.size());
+    for (WasmDataSegment &seg : data_segments) {
+        w.put(seg.init_flags);
+        w.put(seg.memory_index);
+        w.put_init_expr(seg.offset);
+        w.put_str(seg.name);
+        w.put(seg.p2align);
+        w.put(seg.linking_flags);
+    }
+
+    w.put<u32>(sections.size());
+    for (InputSection *isec : sections) {
+        w.put(isec->sec_id);
+        w.put_str(isec->name);
+        w.put_span(isec->get_span());
+        w.put_relocs(isec->relocs);
+    }
+
+    // Fragments with the range of their section's relocations
+    auto put_ifrags = [&](std::vector<InputFragment *> &ifrags) {
+        w.put<u32>(ifrags.size());
+        for (InputFragment *ifrag : ifrags) {
+            std::vector<WasmRelocation> &relocs =
+                sections[ifrag->sec_index]->relocs;
+            w.put(ifrag->sec_index);
+            w.put_span(ifrag->span);
+            w.put(ifrag->in_offset);
+            w.put<u32>(ifrag->relocs.empty()
+                           ? 0
+                           : ifrag->relocs.data() - relocs.data());
+            w.put<u32>(ifrag->relocs.size());
+        }
+    };
+    put_ifrags(code_ifrags);
+    put_ifrags(data_ifrags);
+
+    w.put<u32>(symbols.size());
+    for (WasmSymbol &sym : symbols) {
+        WasmSymbolInfo &info = sym.info;
+        w.put_str(info.name);
+        w.put(info.kind);
+        w.put(info.flags);
+        w.put_opt_str(info.import_module);
+        w.put_opt_str(info.import_name);
+        w.put_opt_str(info.export_name);
+        if (sym.is_type_data()) {
+            w.put(info.value.data_ref.segment);
+            w.put(info.value.data_ref.offset);
+            w.put(info.value.data_ref.size);
+        } else {
+            w.put(info.value.element_index);
+        }
+        w.put<u8>(info.init_func_priority.has_value());
+        w.put<u32>(info.init_func_priority.value_or(0));
+
+        // A global type is that of a defined global or of an imported one.
+        w.put(index_of(signatures, sym.signature));
+        w.put(index_of(globals, sym.global_type));
+        w.put(index_of(imports, sym.global_type));
+        w.put(index_of(imports, sym.table_type));
+    }
+
+    w.put<u32>(comdat_groups.size());
+    for (ComdatGroupRef &ref : comdat_groups) {
+        w.put_str(ref.name);
+        w.put_vec(ref.functions);
+        w.put_vec(ref.data_segments);
+    }
+    return std::move(w.buf);
+}
+
+void ObjectFile::save_parse_cache(Context &ctx) {
+    std::vector<u8> payload = save_parse_state();
+
+    CacheHeader hdr;
+    memcpy(hdr.magic, kCacheMagic, sizeof(hdr.magic));
+    hdr.version = kCacheVersion;
+    hdr.reserved = 0;
+    hdr.input_size = mf->size;
+    hdr.input_hash = hash_string(mf->get_contents());
+    hdr.payload_hash =
+        hash_string({(const char *)payload.data(), payload.size()});
+
+    // Entries are replaced atomically, so that other links sharing the
+    // directory never see a partially written one.
+    std::vector<u8> buf((u8 *)&hdr, (u8 *)&hdr + sizeof(hdr));
+    buf.insert(buf.end(), payload.begin(), payload.end());
+    if (write_file_atomic(get_cache_path(ctx, *this), buf))
+        return;
+
+    static std::atomic_bool warned;
+    if (!warned.exchange(true))
+        Warn(ctx) << "cannot write to cache directory " << ctx.arg.cache_dir
+                  << ": " << errno_string();
+}
+
+bool ObjectFile::load_parse_cache(Context &ctx) {
+    std::string path = get_cache_path(ctx, *this);
+    std::string error;
+    MappedFile *cache = open_file_impl(path, error);
+    if (!cache || !error.empty()) {
+        delete cache;
+        ctx.num_cache_misses++;
+        return false;
+    }
+    ctx.mf_pool.push_back(std::unique_ptr<MappedFile>(cache));
+
+    auto miss = [&] {
+        Debug(ctx, DEBUG_INPUT) << "cache miss: " << filename;
+        ctx.num_cache_misses++;
+        return false;
+    };
+
+    if (cache->size < (i64)sizeof(CacheHeader))
+        return miss();
+    CacheHeader hdr;
+    memcpy(&hdr, cache->data, sizeof(hdr));
+    std::span<const u8> payload{cache->data + sizeof(hdr),
+                                cache->data + cache->size};
+
+    if (memcmp(hdr.magic, kCacheMagic, sizeof(hdr.magic)) ||
+        hdr.version != kCacheVersion || hdr.input_size != (u64)mf->size ||
+        hdr.payload_hash != hash_string({(const char *)payload.data(),
+                                         payload.size()}) ||
+        hdr.input_hash != hash_string(mf->get_contents()) ||
+        !restore_parse_state(ctx, payload))
+        return miss();
+
+    Debug(ctx, DEBUG_INPUT) << "cache hit: " << filename;
+    ctx.num_cache_hits++;
+    return true;
+}
+
+bool ObjectFile::restore_parse_state(Context &ctx,
+                                     std::span<const u8> payload) {
+    // Everything is read into locals first, so that a bad entry leaves
+    // this file untouched and it can still be parsed as usual.
+    CacheReader r(mf, payload);
+
+    u32 imported_globals = r.get<u32>();
+    u32 imported_functions = r.get<u32>();
+    u32 imported_tables = r.get<u32>();
+    u32 imported_memories = r.get<u32>();
+    u32 datacount = r.get<u32>();
+    u32 linking_version = r.get<u32>();
+    std::string_view modname = r.get_str();
+
+    std::vector<WasmSignature> sigs(r.get<u32>());
+    for (WasmSignature &sig : sigs) {
+        sig.returns = r.get_vec<ValType>();
+        sig.params = r.get_vec<ValType>();
+        sig.kind = r.get<decltype(sig.kind)>();
+        sig.state = r.get<decltype(sig.state)>();
+    }
+
+    std::vector<WasmImport> imps(r.get<u32>());
+    for (WasmImport &import : imps) {
+        import.module = r.get_str();
+        import.field = r.get_str();
+        import.kind = r.get<u8>();
+        switch (import.kind) {
+        case WASM_EXTERNAL_FUNCTION:
+            import.sig_index = r.get<u32>();
+            break;
+        case WASM_EXTERNAL_TABLE:
+            import.table.elem_type = r.get<ValType>();
+            import.table.limits = r.get_limits();
+            break;
+        case WASM_EXTERNAL_MEMORY:
+            import.memory = r.get_limits();
+            break;
+        case WASM_EXTERNAL_GLOBAL:
+            import.global = r.get<WasmGlobalType>();
+            break;
+        }
+    }
+
+    std::vector<WasmFunction> funcs(r.get<u32>());
+    for (WasmFunction &func : funcs) {
+        func.index = r.get<u32>();
+        func.sig_index = r.get<u32>();
+        func.symbol_name = r.get_str();
+        func.export_name = r.get_opt_str();
+        func.debug_name = r.get_str();
+    }
+
+    std::vector<WasmLimits> mems(r.get<u32>());
+    for (WasmLimits &limits : mems)
+        limits = r.get_limits();
+
+    std::vector<WasmGlobal> globs(r.get<u32>());
+    for (WasmGlobal &global : globs) {
+        global.type = r.get<WasmGlobalType>();
+        global.init_expr = r.get_init_expr();
+        global.symbol_name = r.get_str();
+    }
+
+    std::vector<WasmExport> exps(r.get<u32>());
+    for (WasmExport &exp : exps) {
+        exp.name = r.get_str();
+        exp.kind = r.get<u8>();
+        exp.index = r.get<u32>();
+    }
+
+    std::vector<WasmElemSegment> elems(r.get<u32>());
+    for (WasmElemSegment &seg : elems) {
+        seg.flags = r.get<u32>();
+        seg.table_number = r.get<u32>();
+        seg.elem_kind = r.get<ValType>();
+        seg.offset = r.get_init_expr();
+        seg.functions = r.get_vec<u32>();
+    }
+
+    std::vector<WasmDataSegment> segs(r.get<u32>());
+    for (WasmDataSegment &seg : segs) {
+        seg.init_flags = r.get<u32>();
+        seg.memory_index = r.get<u32>();
+        seg.offset = r.get_init_expr();
+        seg.name = r.get_str();
+        seg.p2align = r.get<u32>();
+        seg.linking_flags = r.get<u32>();
+    }
+
+    struct SectionEntry {
+        u8 sec_id;
+        std::string_view name;
+        std::span<const u8> span;
+        std::vector<WasmRelocation> relocs;
+    };
+    std::vector<SectionEntry> secs(r.get<u32>());
+    for (SectionEntry &ent : secs) {
+        ent.sec_id = r.get<u8>();
+        ent.name = r.get_str();
+        ent.span = r.get_span();
+        ent.relocs = r.get_relocs();
+    }
+
+    struct FragmentEntry {
+        u32 sec_index;
+        std::span<const u8> span;
+        u64 in_offset;
+        u32 reloc_begin;
+        u32 num_relocs;
+    };
+    auto get_ifrags = [&] {
+        std::vector<FragmentEntry> vec(r.get<u32>());
+        for (FragmentEntry &ent : vec) {
+            ent.sec_index = r.get<u32>();
+            ent.span = r.get_span();
+            ent.in_offset = r.get<u64>();
+            ent.reloc_begin = r.get<u32>();
+            ent.num_relocs = r.get<u32>();
+            if (ent.sec_index >= secs.size() ||
+                (u64)ent.reloc_begin + ent.num_relocs >
+                    secs[ent.sec_index].relocs.size())
+                r.ok = false;
+        }
+        return vec;
+    };
+    std::vector<FragmentEntry> code_ents = get_ifrags();
+    std::vector<FragmentEntry> data_ents = get_ifrags();
+
+    struct SymbolEntry {
+        WasmSymbolInfo info;
+        i32 signature;
+        i32 global;
+        i32 imported_global;
+        i32 imported_table;
+    };
+    std::vector<SymbolEntry> syms(r.get<u32>());
+    for (SymbolEntry &ent : syms) {
+        WasmSymbolInfo &info = ent.info;
+        info.name = r.get_str();
+        info.kind = r.get<WasmSymbolType>();
+        info.flags = r.get<u32>();
+        info.import_module = r.get_opt_str();
+        info.import_name = r.get_opt_str();
+        info.export_name = r.get_opt_str();
+        info.value = {};
+        if (info.kind == WASM_SYMBOL_TYPE_DATA) {
+            info.value.data_ref.segment = r.get<u32>();
+            info.value.data_ref.offset = r.get<u64>();
+            info.value.data_ref.size = r.get<u64>();
+        } else {
+            info.value.element_index = r.get<u32>();
+        }
+        bool has_priority = r.get<u8>();
+        u32 priority = r.get<u32>();
+        if (has_priority)
+            info.init_func_priority = priority;
+
+        ent.signature = r.get<i32>();
+        ent.global = r.get<i32>();
+        ent.imported_global = r.get<i32>();
+        ent.imported_table = r.get<i32>();
+        if (ent.signature >= (i64)sigs.size() ||
+            ent.global >= (i64)globs.size() ||
+            ent.imported_global >= (i64)imps.size() ||
+            ent.imported_table >= (i64)imps.size())
+            r.ok = false;
+    }
+
+    struct ComdatEntry {
+        std::string_view name;
+        std::vector<u32> functions;
+        std::vector<u32> data_segments;
+    };
+    std::vector<ComdatEntry> comdats(r.get<u32>());
+    for (ComdatEntry &ent : comdats) {
+        ent.name = r.get_str();
+        ent.functions = r.get_vec<u32>();
+        ent.data_segments = r.get_vec<u32>();
+    }
+
+    if (!r.ok || !r.at_end())
+        return false;
+
+    // The entry is good. Move it into place.
+    num_imported_globals = imported_globals;
+    num_imported_functions = imported_functions;
+    num_imported_tables = imported_tables;
+    num_imported_memories = imported_memories;
+    data_count = datacount;
+    linking_data.version = linking_version;
+    module_name = modname;
+    signatures = std::move(sigs);
+    imports = std::move(imps);
+    functions = std::move(funcs);
+    memories = std::move(mems);
+    globals = std::move(globs);
+    exports = std::move(exps);
+    elem_segments = std::move(elems);
+    data_segments = std::move(segs);
+
+    for (u32 i = 0; i < secs.size(); i++) {
+        InputSection *isec = arena.create<InputSection>(
+            secs[i].sec_id, i, this, secs[i].name, secs[i].span);
+        isec->relocs = std::move(secs[i].relocs);
+        sections.push_back(isec);
+        if (isec->sec_id == WASM_SEC_CUSTOM)
+            customs.push_back(isec);
+    }
+
+    auto set_ifrags = [&](std::vector<InputFragment *> &ifrags,
+                          std::vector<FragmentEntry> &ents) {
+        InputFragment *frags = arena.allocate_array<InputFragment>(ents.size());
+        ifrags.resize(ents.size());
+        for (size_t i = 0; i < ents.size(); i++) {
+            FragmentEntry &ent = ents[i];
+            ifrags[i] = new (frags + i)
+                InputFragment(ent.sec_index, this, ent.span, ent.in_offset);
+            ifrags[i]->relocs = std::span(sections[ent.sec_index]->relocs)
+                                    .subspan(ent.reloc_begin, ent.num_relocs);
+        }
+    };
+    set_ifrags(code_ifrags, code_ents);
+    set_ifrags(data_ifrags, data_ents);
+
+    symbols.reserve(syms.size());
+    for (SymbolEntry &ent : syms) {
+        const WasmSignature *sig =
+            (ent.signature < 0) ? nullptr : &signatures[ent.signature];
+        const WasmGlobalType *global_type = nullptr;
+        if (ent.global >= 0)
+            global_type = &globals[ent.global].type;
+        else if (ent.imported_global >= 0)
+            global_type = &imports[ent.imported_global].global;
+        const WasmTableType *table_type =
+            (ent.imported_table < 0) ? nullptr
+                                     : &imports[ent.imported_table].table;
+        symbols.push_back(WasmSymbol(ent.info, global_type, table_type, sig));
+    }
+
+    for (ComdatEntry &ent : comdats) {
+        ComdatGroupRef ref;
+        ref.group =
+            ctx.comdat_groups.insert(ent.name, hash_string(ent.name)).first;
+        ref.name = ent.name;
+        ref.functions = std::move(ent.functions);
+        ref.data_segments = std::move(ent.data_segments);
+        comdat_groups.push_back(std::move(ref));
+    }
+    return true;
+}
+
+} // namespace xld::wasm
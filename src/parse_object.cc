@@ -3,22 +3,30 @@
 #include "common/log.h"
 #include "common/system.h"
 #include "wasm/object.h"
+#include "oneapi/tbb/parallel_for.h"
 #include "xld.h"
 
 namespace xld::wasm {
 
+// Code and data sections at least this large are processed in parallel
+// chunks, so that one huge object file does not keep a single core busy
+// while the others idle. Smaller ones are not worth the overhead.
+static constexpr i64 kParallelSectionSize = 1024 * 1024;
+// Number of fragments per chunk
+static constexpr i64 kParallelGrainSize = 1024;
+
 static void set_relocs(Context &ctx, ObjectFile *);
 
 static u32 parse_varuint32(const u8 *&data) {
-    return decodeULEB128AndInc(data);
+    return decode_uleb128_fast(data);
 }
 /*
 static u64 parse_varuint64(const u8 *&data) {
-    return decodeULEB128AndInc(data);
+    return decode_uleb128_fast(data);
 }
 */
-static i32 parse_varint32(const u8 *&data) { return decodeSLEB128AndInc(data); }
-static i64 parse_varint64(const u8 *&data) { return decodeSLEB128AndInc(data); }
+static i32 parse_varint32(const u8 *&data) { return decode_sleb128_fast(data); }
+static i64 parse_varint64(const u8 *&data) { return decode_sleb128_fast(data); }
 
 static i32 parse_float32(const u8 *&data) {
     i32 result = 0;
@@ -36,43 +44,41 @@ static i64 parse_float64(const u8 *&data) {
 
 // Parse vector of variable-length element and increment pointer
 // f needs to increment pointer
-template <typename T>
-std::vector<T> parse_vec_varlen(const u8 *&data,
-                                std::function<T(const u8 *&)> f) {
+template <typename F>
+static auto parse_vec_varlen(const u8 *&data, F f) {
     u32 num = parse_varuint32(data);
-    std::vector<T> v;
-    for (u32 i = 0; i < num; i++) {
-        v.push_back(f(data));
-    }
-    return v;
+    std::vector<decltype(f(data))> vec;
+    vec.reserve(num);
+    for (u32 i = 0; i < num; i++)
+        vec.push_back(f(data));
+    return vec;
 }
 
-static void foreach_vec(const u8 *&data, std::function<void(const u8 *&)> f) {
+// Call f for each element of vector and increment pointer
+// f needs to increment pointer
+template <typename F>
+static void foreach_vec(const u8 *&data, F f) {
     u32 num = parse_varuint32(data);
-    for (u32 i = 0; i < num; i++) {
+    for (u32 i = 0; i < num; i++)
         f(data);
-    }
 }
 
 // Parse vector of fix-length element and increment pointer
 template <typename T>
 static std::vector<T> parse_vec(const u8 *&data) {
+    static_assert(std::is_trivially_copyable_v<T>);
     u32 num = parse_varuint32(data);
-    std::vector<T> vec;
-    if constexpr (std::is_same<T, u8>::value) {
-        vec = std::vector<T>{data, data + sizeof(T) * num};
-    } else {
-        const T *p = reinterpret_cast<const T *>(data);
-        vec = std::vector<T>{p, p + sizeof(T) * num};
-    }
+    std::vector<T> vec(num);
+    memcpy(vec.data(), data, sizeof(T) * num);
     data += sizeof(T) * num;
     return vec;
 }
 
-// Parse name and increment pointer
-static std::string parse_name(const u8 *&data) {
+// Parse name and increment pointer. The name points into the input file,
+// which is mapped until exit, so it is not copied.
+static std::string_view parse_name(const u8 *&data) {
     u64 num = parse_varuint32(data);
-    std::string name{data, data + num};
+    std::string_view name{(const char *)data, num};
     data += num;
     return name;
 }
@@ -120,10 +126,8 @@ static InputFragment *parse_ifrag(Context &ctx, u32 sec_index, ObjectFile *obj,
     u32 in_offset = data - content_beg;
     std::span<const u8> content{data, data + len};
     data += len;
-    InputFragment *ifrag =
-        new InputFragment(sec_index, obj, content, in_offset);
-    ctx.ifrag_pool.emplace_back(std::unique_ptr<InputFragment>(ifrag));
-    return ifrag;
+    return obj->arena.create<InputFragment>(sec_index, obj, content,
+                                            in_offset);
 }
 
 static std::string_view sec_id_as_str(u8 sec_id) {
@@ -197,6 +201,7 @@ void ObjectFile::parse_linking_sec(Context &ctx, const u8 *&p, const u32 size) {
         switch (type) {
         case WASM_SYMBOL_TABLE: {
             u64 count = parse_varuint32(p);
+            this->symbols.reserve(count);
             while (count--) {
                 WasmSymbolType type{*p};
                 p++;
@@ -211,9 +216,9 @@ void ObjectFile::parse_linking_sec(Context &ctx, const u8 *&p, const u32 size) {
                 case WASM_SYMBOL_TYPE_FUNCTION: {
                     u32 index = parse_varuint32(p);
 
-                    std::string symbol_name;
-                    std::optional<std::string> import_module;
-                    std::optional<std::string> import_name;
+                    std::string_view symbol_name;
+                    std::optional<std::string_view> import_module;
+                    std::optional<std::string_view> import_name;
                     if (is_defined) {
                         if (!is_defined_function(index))
                             Error(ctx) << "function index=" << index
@@ -251,9 +256,9 @@ void ObjectFile::parse_linking_sec(Context &ctx, const u8 *&p, const u32 size) {
                 case WASM_SYMBOL_TYPE_GLOBAL: {
                     u32 index = parse_varuint32(p);
                     // linking name
-                    std::string symbol_name;
-                    std::optional<std::string> import_module;
-                    std::optional<std::string> import_name;
+                    std::string_view symbol_name;
+                    std::optional<std::string_view> import_module;
+                    std::optional<std::string_view> import_name;
 
                     if (!is_defined &&
                         (flags & wasm::WASM_SYMBOL_BINDING_MASK) ==
@@ -292,7 +297,7 @@ void ObjectFile::parse_linking_sec(Context &ctx, const u8 *&p, const u32 size) {
                                           .init_func_priority = std::nullopt};
                 } break;
                 case WASM_SYMBOL_TYPE_DATA: {
-                    std::string name = parse_name(p);
+                    std::string_view name = parse_name(p);
                     u32 segment_index = 0;
                     u32 offset = 0;
                     u32 size = 0;
@@ -335,14 +340,13 @@ void ObjectFile::parse_linking_sec(Context &ctx, const u8 *&p, const u32 size) {
         } break;
         case WASM_SEGMENT_INFO: {
             u32 index = 0;
-            std::function<void(const u8 *&)> f = [&](const u8 *&data) {
+            foreach_vec(p, [&](const u8 *&data) {
                 this->data_segments[index].name = parse_name(data);
                 this->data_segments[index].p2align = parse_varuint32(data);
                 this->data_segments[index].linking_flags =
                     parse_varuint32(data);
                 index++;
-            };
-            foreach_vec(p, f);
+            });
         } break;
         case WASM_INIT_FUNCS: {
             u32 count = parse_varuint32(p);
@@ -351,17 +355,28 @@ void ObjectFile::parse_linking_sec(Context &ctx, const u8 *&p, const u32 size) {
                 u32 symbol_index = parse_varuint32(p);
                 if (!is_valid_function_symbol(symbol_index))
                     Error(ctx) << "invalid function symbol";
-                Debug(ctx) << "init_func_priority=" << priority
-                           << " symbol=" << symbols[symbol_index].info.name;
+                Debug(ctx, DEBUG_INPUT)
+                    << "init_func_priority=" << priority
+                    << " symbol=" << symbols[symbol_index].info.name;
                 symbols[symbol_index].info.init_func_priority = priority;
             }
         } break;
         case WASM_COMDAT_INFO: {
             u32 count = parse_varuint32(p);
             while (count--) {
-                std::string name = parse_name(p);
+                // The name refers to the mapped file, which outlives the
+                // group table.
+                u32 len = parse_varuint32(p);
+                std::string_view name((const char *)p, len);
+                p += len;
                 // flags, currently ignored.
                 parse_varuint32(p);
+
+                ComdatGroupRef ref;
+                ref.group =
+                    ctx.comdat_groups.insert(name, hash_string(name)).first;
+                ref.name = name;
+
                 u32 num_syms = parse_varuint32(p);
                 while (num_syms--) {
                     u8 kind = *p;
@@ -371,14 +386,22 @@ void ObjectFile::parse_linking_sec(Context &ctx, const u8 *&p, const u32 size) {
                     case WASM_COMDAT_FUNCTION:
                         if (!is_defined_function(index))
                             Error(ctx) << "invalid function symbol";
+                        else
+                            ref.functions.push_back(index);
+                        break;
+                    case WASM_COMDAT_DATA:
+                        if (index >= data_ifrags.size())
+                            Error(ctx) << "invalid data segment index";
+                        else
+                            ref.data_segments.push_back(index);
                         break;
                     default:
+                        // Custom sections are not copied to the output.
                         break;
                     }
-                    // TODO: deal with COMDAT
                 }
+                comdat_groups.push_back(std::move(ref));
             }
-
         } break;
         default: {
             Error(ctx) << "TODO: Unknown linking entry type: " << (int)type;
@@ -397,11 +420,22 @@ void ObjectFile::parse_reloc_sec(Context &ctx, const u8 *&p, const u32 size) {
             << "relocations must refer to the code or data or custom section ("
             << this->filename << ")";
     u32 count = parse_varuint32(p);
+    sections[sec_idx]->relocs.reserve(count);
     for (u32 i = 0; i < count; i++) {
         u8 type = *p;
         p++;
         u32 offset = parse_varuint32(p);
         u32 index = parse_varuint32(p);
+        if (!is_known_reloc_type(type))
+            Fatal(ctx) << this->filename << ": unknown relocation type: "
+                       << (u32)type;
+        u32 num_indices = (type == R_WASM_TYPE_INDEX_LEB)
+                              ? this->signatures.size()
+                              : this->symbols.size();
+        if (index >= num_indices)
+            Fatal(ctx) << this->filename << ": relocation "
+                       << get_reloc_type_name(type)
+                       << " refers to out-of-range index " << index;
         i32 addend = 0;
         switch (type) {
         // R_WASM_MEMORY_*
@@ -454,7 +488,7 @@ void ObjectFile::parse_name_sec(Context &ctx, const u8 *&p, const u32 size) {
             u32 count = parse_varuint32(p);
             while (count--) {
                 u32 func_index = parse_varuint32(p);
-                std::string name = parse_name(p);
+                std::string_view name = parse_name(p);
                 if (is_defined_function(func_index)) {
                     WasmFunction &func = get_defined_function(func_index);
                     func.debug_name = name;
@@ -475,10 +509,10 @@ void ObjectFile::parse_name_sec(Context &ctx, const u8 *&p, const u32 size) {
             u32 count = parse_varuint32(p);
             for (u32 j = 0; j < count; j++) {
                 u32 global_index = parse_varuint32(p);
-                std::string name = parse_name(p);
+                std::string_view name = parse_name(p);
                 // TODO:
-                Debug(ctx) << "global[" << global_index
-                           << "].debug_name=" << name;
+                Debug(ctx, DEBUG_INPUT) << "global[" << global_index
+                                        << "].debug_name=" << name;
             }
         } break;
         default:
@@ -590,9 +624,107 @@ WasmInitExpr ObjectFile::parse_init_expr(Context &ctx, const u8 *&data) {
                         .body = std::span<const u8>(data_beg, data)};
 }
 
+// Reads the symbol table of the "linking" section, skipping everything
+// else, and calls `fn` with the name of each non-local symbol the object
+// file defines. This is used to index archives, so it must be much
+// cheaper than parse().
+void read_defined_symbols(
+    Context &ctx, MappedFile *mf,
+    const std::function<void(std::string_view)> &fn) {
+    const u8 *const data = mf->data;
+    const u8 *p = data + sizeof(WasmObjectHeader);
+
+    while (p - data < mf->size) {
+        u8 sec_id = *p;
+        p++;
+        u32 content_size = parse_varuint32(p);
+        const u8 *content_end = p + content_size;
+        if (sec_id != WASM_SEC_CUSTOM) {
+            p = content_end;
+            continue;
+        }
+
+        u32 name_len = parse_varuint32(p);
+        std::string_view sec_name((const char *)p, name_len);
+        p += name_len;
+        if (sec_name != "linking") {
+            p = content_end;
+            continue;
+        }
+
+        // version
+        parse_varuint32(p);
+        while (p < content_end) {
+            u8 type = *p;
+            p++;
+            u32 size = parse_varuint32(p);
+            if (type != WASM_SYMBOL_TABLE) {
+                p += size;
+                continue;
+            }
+
+            u32 count = parse_varuint32(p);
+            while (count--) {
+                u8 kind = *p;
+                p++;
+                u32 flags = parse_varuint32(p);
+                bool is_defined = (flags & WASM_SYMBOL_UNDEFINED) == 0;
+                bool has_name = true;
+
+                switch (kind) {
+                case WASM_SYMBOL_TYPE_FUNCTION:
+                case WASM_SYMBOL_TYPE_GLOBAL:
+                case WASM_SYMBOL_TYPE_TABLE:
+                case WASM_SYMBOL_TYPE_TAG:
+                    // index
+                    parse_varuint32(p);
+                    has_name =
+                        is_defined || (flags & WASM_SYMBOL_EXPLICIT_NAME);
+                    break;
+                case WASM_SYMBOL_TYPE_DATA:
+                    break;
+                case WASM_SYMBOL_TYPE_SECTION:
+                    parse_varuint32(p);
+                    continue;
+                default:
+                    Fatal(ctx) << mf->name << ": unknown symbol type: "
+                               << (int)kind;
+                }
+
+                std::string_view name;
+                if (has_name) {
+                    u32 len = parse_varuint32(p);
+                    name = {(const char *)p, len};
+                    p += len;
+                }
+
+                // segment index, offset and size
+                if (kind == WASM_SYMBOL_TYPE_DATA && is_defined) {
+                    parse_varuint32(p);
+                    parse_varuint32(p);
+                    parse_varuint32(p);
+                }
+
+                if (is_defined && (flags & WASM_SYMBOL_BINDING_MASK) !=
+                                      WASM_SYMBOL_BINDING_LOCAL)
+                    fn(name);
+            }
+            return;
+        }
+        return;
+    }
+}
+
 void ObjectFile::parse(Context &ctx) {
     if (mf == nullptr)
         return;
+    if (ctx.resident && ctx.resident->load_parse_state(ctx, *this))
+        return;
+    if (!ctx.arg.cache_dir.empty() && load_parse_cache(ctx)) {
+        if (ctx.resident)
+            ctx.resident->save_parse_state(*this);
+        return;
+    }
 
     u8 *const data = this->mf->data;
     const u8 *p = data + sizeof(WasmObjectHeader);
@@ -603,7 +735,7 @@ void ObjectFile::parse(Context &ctx) {
         p++;
         u32 content_size = parse_varuint32(p);
 
-        std::string sec_name{sec_id_as_str(sec_id)};
+        std::string_view sec_name = sec_id_as_str(sec_id);
         // Debug(ctx) << "parsing " << sec_name << " (" << sec_index
         //           << "th section)";
 
@@ -628,15 +760,14 @@ void ObjectFile::parse(Context &ctx) {
             }
         } break;
         case WASM_SEC_TYPE: {
-            std::function<WasmSignature(const u8 *&)> f = [&](const u8 *&data) {
+            this->signatures = parse_vec_varlen(p, [&](const u8 *&data) {
                 ASSERT(*data == 0x60 && "type section must start with 0x60");
                 data++;
                 // discard results
                 std::vector<ValType> params = parse_vec<ValType>(data);
                 std::vector<ValType> returns = parse_vec<ValType>(data);
                 return WasmSignature(returns, params);
-            };
-            this->signatures = parse_vec_varlen(p, f);
+            });
         } break;
         case WASM_SEC_TABLE: {
             // skip
@@ -644,9 +775,9 @@ void ObjectFile::parse(Context &ctx) {
             p = content_beg + content_size;
         } break;
         case WASM_SEC_IMPORT: {
-            std::function<WasmImport(const u8 *&)> f = [&](const u8 *&data) {
-                std::string module = parse_name(data);
-                std::string field = parse_name(data);
+            auto f = [&](const u8 *&data) -> WasmImport {
+                std::string_view module = parse_name(data);
+                std::string_view field = parse_name(data);
                 WasmImportKind kind = WasmImportKind(*data);
                 data++;
                 switch (kind) {
@@ -686,17 +817,16 @@ void ObjectFile::parse(Context &ctx) {
             this->imports = parse_vec_varlen(p, f);
         } break;
         case WASM_SEC_FUNCTION: {
-            std::function<void(const u8 *&)> f = [&](const u8 *&data) {
-                u32 sig_index = parse_varuint32(p);
+            u32 index = num_imported_functions;
+            this->functions = parse_vec_varlen(p, [&](const u8 *&data) {
+                u32 sig_index = parse_varuint32(data);
                 if (sig_index >= this->signatures.size())
                     Fatal(ctx)
                         << "sig_index=" << sig_index << " is out of range";
-
-                u32 index = num_imported_functions + this->functions.size();
-                this->functions.push_back(WasmFunction{
-                    .index = index, .sig_index = sig_index, .symbol_name = ""});
-            };
-            foreach_vec(p, f);
+                return WasmFunction{.index = index++,
+                                    .sig_index = sig_index,
+                                    .symbol_name = ""};
+            });
         } break;
         case WASM_SEC_ELEM: {
             u32 count = parse_varuint32(p);
@@ -782,8 +912,8 @@ void ObjectFile::parse(Context &ctx) {
             }
         } break;
         case WASM_SEC_EXPORT: {
-            std::function<WasmExport(const u8 *&)> f = [&](const u8 *&data) {
-                std::string name = parse_name(data);
+            this->exports = parse_vec_varlen(p, [&](const u8 *&data) {
+                std::string_view name = parse_name(data);
                 WasmImportKind kind = WasmImportKind(*data);
                 data++;
                 u32 index = parse_varuint32(data);
@@ -815,38 +945,51 @@ void ObjectFile::parse(Context &ctx) {
                     break;
                 }
                 return WasmExport{name, kind, index};
-            };
-            this->exports = parse_vec_varlen(p, f);
+            });
         } break;
         case WASM_SEC_MEMORY: {
-            std::function<void(const u8 *&)> f = [&](const u8 *&data) {
-                WasmLimits limits = parse_limits(data);
-                this->memories.push_back(limits);
-            };
-            foreach_vec(p, f);
+            this->memories = parse_vec_varlen(p, parse_limits);
         } break;
         case WASM_SEC_GLOBAL: {
-            std::function<void(const u8 *&)> f = [&](const u8 *&data) {
+            this->globals = parse_vec_varlen(p, [&](const u8 *&data) {
                 const ValType val_type{*data};
                 data++;
                 const bool mut = *data;
                 data++;
                 WasmInitExpr init_expr = parse_init_expr(ctx, data);
-                this->globals.push_back(WasmGlobal{
+                return WasmGlobal{
                     .type = {.type = val_type, .mut = mut},
                     .init_expr = init_expr,
                     .symbol_name = "",
-                });
-            };
-            foreach_vec(p, f);
+                };
+            });
         } break;
         case WASM_SEC_CODE: {
+            // Skim the size prefixes of the function bodies first. The
+            // fragments are then created in parallel for a large section.
             u32 count = parse_varuint32(p);
+            std::vector<std::span<const u8>> bodies;
+            bodies.reserve(count);
             while (count--) {
-                InputFragment *ifrag =
-                    parse_ifrag(ctx, sec_index, this, p, content_beg);
-                this->code_ifrags.emplace_back(ifrag);
+                u32 len = parse_varuint32(p);
+                bodies.push_back({p, len});
+                p += len;
             }
+
+            InputFragment *frags =
+                this->arena.allocate_array<InputFragment>(bodies.size());
+            this->code_ifrags.resize(bodies.size());
+            auto create = [&](size_t i) {
+                u64 in_offset = bodies[i].data() - content_beg;
+                this->code_ifrags[i] = new (frags + i)
+                    InputFragment(sec_index, this, bodies[i], in_offset);
+            };
+
+            if (content_size >= kParallelSectionSize)
+                tbb::parallel_for((size_t)0, bodies.size(), create);
+            else
+                for (size_t i = 0; i < bodies.size(); i++)
+                    create(i);
         } break;
         case WASM_SEC_DATACOUNT: {
             this->data_count = parse_varuint32(p);
@@ -855,6 +998,8 @@ void ObjectFile::parse(Context &ctx) {
             u32 datacount = parse_varuint32(p);
             if (datacount != this->data_count)
                 Fatal(ctx) << "datacount section is not equal to data section";
+            this->data_ifrags.reserve(datacount);
+            this->arena.reserve<InputFragment>(datacount);
 
             while (datacount--) {
                 u32 flags = parse_varuint32(p);
@@ -914,9 +1059,8 @@ void ObjectFile::parse(Context &ctx) {
 
         ASSERT(sections.size() == sec_index);
         {
-            InputSection *isec =
-                new InputSection(sec_id, sec_index, this, sec_name, content);
-            ctx.isec_pool.emplace_back(isec);
+            InputSection *isec = this->arena.create<InputSection>(
+                sec_id, sec_index, this, sec_name, content);
             this->sections.emplace_back(isec);
 
             if (sec_id == WASM_SEC_CUSTOM) {
@@ -928,36 +1072,79 @@ void ObjectFile::parse(Context &ctx) {
     }
 
     set_relocs(ctx, this);
+
+    if (ctx.has_error)
+        return;
+    if (ctx.resident)
+        ctx.resident->save_parse_state(*this);
+    if (!ctx.arg.cache_dir.empty())
+        save_parse_cache(ctx);
 }
 
+// Distributes relocations of the code and data sections to the function
+// bodies and data segments they apply to. Both fragments and relocations
+// are sorted by offset, so each section takes a single merge pass, and
+// each fragment gets the span of the section's relocations that falls
+// within it. A large section is merged in parallel chunks.
 static void set_relocs(Context &ctx, ObjectFile *obj) {
-    for (InputFragment *ifrag : obj->get_function_codes()) {
+    auto set = [&](std::vector<InputFragment *> &ifrags) {
+        if (ifrags.empty())
+            return;
+
+        InputSection *isec = obj->sections[ifrags[0]->sec_index];
+        std::vector<WasmRelocation> &relocs = isec->relocs;
         auto cmp = [](const WasmRelocation &a, const WasmRelocation &b) {
             return a.offset < b.offset;
         };
-        std::vector<WasmRelocation> &relocs =
-            obj->sections[ifrag->sec_index]->relocs;
-        bool is_sorted = std::is_sorted(relocs.begin(), relocs.end(), cmp);
-        if (!is_sorted)
-            Error(ctx) << "relocations are not sorted";
-
-        // TODO: use binary search
-        for (WasmRelocation &reloc : relocs) {
-            if (ifrag->in_offset <= reloc.offset &&
-                reloc.offset <= ifrag->in_offset + ifrag->get_size()) {
-                ifrag->relocs.emplace_back(reloc);
-            }
+        if (!std::is_sorted(relocs.begin(), relocs.end(), cmp)) {
+            Error(ctx) << obj->filename << ": relocations are not sorted";
+            return;
         }
-    }
+
+        // Assigns relocations to ifrags[begin, end). The first fragment's
+        // relocations are found by binary search, and the rest by merging.
+        auto assign = [&](size_t begin, size_t end) {
+            auto it = std::partition_point(
+                relocs.begin(), relocs.end(), [&](const WasmRelocation &r) {
+                    return r.offset < ifrags[begin]->in_offset;
+                });
+            size_t i = it - relocs.begin();
+
+            for (size_t j = begin; j < end; j++) {
+                InputFragment *ifrag = ifrags[j];
+                u64 frag_begin = ifrag->in_offset;
+                u64 frag_end = frag_begin + ifrag->get_size();
+                while (i < relocs.size() && relocs[i].offset < frag_begin)
+                    i++;
+                size_t first = i;
+                while (i < relocs.size() && relocs[i].offset < frag_end)
+                    i++;
+                ifrag->relocs = std::span(relocs).subspan(first, i - first);
+            }
+        };
+
+        if (isec->get_size() >= kParallelSectionSize)
+            tbb::parallel_for(
+                tbb::blocked_range<size_t>(0, ifrags.size(),
+                                           kParallelGrainSize),
+                [&](const tbb::blocked_range<size_t> &r) {
+                    assign(r.begin(), r.end());
+                });
+        else
+            assign(0, ifrags.size());
+    };
+
+    set(obj->code_ifrags);
+    set(obj->data_ifrags);
 }
 
 void ObjectFile::dump(Context &ctx) {
-    Debug(ctx) << "=== " << this->mf->name << " ===";
-    Debug(ctx) << "Type section";
+    SyncOut(ctx) << "=== " << this->mf->name << " ===";
+    SyncOut(ctx) << "Type section";
     for (u32 i = 0; i < this->signatures.size(); i++) {
-        Debug(ctx) << "  - type[" << i << "]";
+        SyncOut(ctx) << "  - type[" << i << "]";
     }
-    Debug(ctx) << "Import section";
+    SyncOut(ctx) << "Import section";
     {
         u32 func_index = 0;
         u32 table_index = 0;
@@ -966,78 +1153,79 @@ void ObjectFile::dump(Context &ctx) {
         for (WasmImport &import : this->imports) {
             switch (import.kind) {
             case WASM_EXTERNAL_FUNCTION:
-                Debug(ctx) << "  - func[" << func_index
-                           << "]: " << import.module << "." << import.field;
+                SyncOut(ctx) << "  - func[" << func_index
+                             << "]: " << import.module << "." << import.field;
                 func_index++;
                 break;
             case WASM_EXTERNAL_TABLE:
-                Debug(ctx) << "  - table[" << table_index
-                           << "]: " << import.module << "." << import.field;
+                SyncOut(ctx) << "  - table[" << table_index
+                             << "]: " << import.module << "." << import.field;
                 table_index++;
                 break;
             case WASM_EXTERNAL_MEMORY:
-                Debug(ctx) << "  - memory[" << memory_index
-                           << "]: " << import.module << "." << import.field;
+                SyncOut(ctx) << "  - memory[" << memory_index
+                             << "]: " << import.module << "." << import.field;
                 memory_index++;
                 break;
             case WASM_EXTERNAL_GLOBAL:
-                Debug(ctx) << "  - global[" << global_index
-                           << "]: " << import.module << "." << import.field;
+                SyncOut(ctx) << "  - global[" << global_index
+                             << "]: " << import.module << "." << import.field;
                 global_index++;
                 break;
             }
         }
     }
-    Debug(ctx) << "Function section";
+    SyncOut(ctx) << "Function section";
     for (u32 i = 0; i < this->functions.size(); i++) {
         const WasmFunction &func = this->functions[i];
-        Debug(ctx) << "  - func[" << i + num_imported_functions
-                   << "]: " << func.symbol_name << " (type[" << func.sig_index
-                   << "], export_name=" << func.export_name.value_or("<null>")
-                   << ")";
+        SyncOut(ctx) << "  - func[" << i + num_imported_functions
+                     << "]: " << func.symbol_name << " (type[" << func.sig_index
+                     << "], export_name=" << func.export_name.value_or("<null>")
+                     << ")";
     }
-    Debug(ctx) << "Memory section";
+    SyncOut(ctx) << "Memory section";
     for (u32 i = 0; i < this->memories.size(); i++) {
         const WasmLimits &mem = this->memories[i];
-        Debug(ctx) << "  - memory[" << i + num_imported_memories
-                   << "]: min=" << mem.minimum << ", max=" << mem.maximum;
+        SyncOut(ctx) << "  - memory[" << i + num_imported_memories
+                     << "]: min=" << mem.minimum << ", max=" << mem.maximum;
     }
-    Debug(ctx) << "Global section";
+    SyncOut(ctx) << "Global section";
     for (u32 i = 0; i < this->globals.size(); i++) {
         const WasmGlobal &global = this->globals[i];
-        Debug(ctx) << "  - global[" << i + num_imported_globals
-                   << "]: " << global.symbol_name;
+        SyncOut(ctx) << "  - global[" << i + num_imported_globals
+                     << "]: " << global.symbol_name;
     }
-    Debug(ctx) << "Export section";
+    SyncOut(ctx) << "Export section";
     for (u32 i = 0; i < this->exports.size(); i++) {
-        Debug(ctx) << "  - export[" << i << "]: " << this->exports[i].name;
+        SyncOut(ctx) << "  - export[" << i << "]: " << this->exports[i].name;
     }
-    Debug(ctx) << "Code section";
+    SyncOut(ctx) << "Code section";
     /*
     for (int i = 0; i < this->codes.size(); i++) {
-        Debug(ctx) << "  - code[" << i << "]";
+        SyncOut(ctx) << "  - code[" << i << "]";
     }
     */
-    Debug(ctx) << "Data section";
+    SyncOut(ctx) << "Data section";
     for (u32 i = 0; i < this->data_segments.size(); i++) {
         // WasmDataSegment &data_seg = this->data_segments[i];
-        Debug(ctx) << "  - data[" << i << "]";
+        SyncOut(ctx) << "  - data[" << i << "]";
     }
-    Debug(ctx) << "Linking-Symbol section";
+    SyncOut(ctx) << "Linking-Symbol section";
     for (u32 i = 0; i < this->symbols.size(); i++) {
-        WasmSymbol sym = this->symbols[i];
-        std::string symname = sym.info.import_name.has_value()
-                                  ? (sym.info.import_module.value() + "." +
-                                     sym.info.import_name.value())
-                                  : sym.info.name;
-        Debug(ctx) << "  - symbol[" << i << "]: " << symname;
+        WasmSymbol &sym = this->symbols[i];
+        if (sym.info.import_name.has_value())
+            SyncOut(ctx) << "  - symbol[" << i
+                         << "]: " << sym.info.import_module.value() << "."
+                         << sym.info.import_name.value();
+        else
+            SyncOut(ctx) << "  - symbol[" << i << "]: " << sym.info.name;
     }
-    Debug(ctx) << "Linking-Data section";
+    SyncOut(ctx) << "Linking-Data section";
     for (u32 i = 0; i < this->data_segments.size(); i++) {
         WasmDataSegment &data_seg = this->data_segments[i];
-        Debug(ctx) << "  - data[" << i << "]: " << data_seg.name;
+        SyncOut(ctx) << "  - data[" << i << "]: " << data_seg.name;
     }
-    Debug(ctx) << "=== Dump Ends ===";
+    SyncOut(ctx) << "=== Dump Ends ===";
 }
 
 } // namespace xld::wasm
@@ -16,19 +16,120 @@
 #include <set>
 #include <sstream>
 #include <string_view>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace xld::wasm {
 
+// Returns the archive member which defines `name`, or nullptr. Archives
+// are searched in command-line order, and the first member of an archive
+// wins, which is the member with the highest priority.
+static ObjectFile *find_archive_member(Context &ctx, std::string_view name) {
+    u64 hash = hash_string(name);
+    for (Archive *ar : ctx.archives)
+        if (ObjectFile *file = ar->find_member(ctx, name, hash))
+            return file;
+    return nullptr;
+}
+
+// Extracts archive members until no live file has an undefined reference
+// to a symbol some member defines. This proceeds in rounds: each round
+// scans the files that became live in the previous one, in parallel, and
+// then parses and resolves the members they need, also in parallel. A
+// member is picked only by looking at symbols resolved in earlier rounds,
+// so the set of extracted members does not depend on thread scheduling.
+static void extract_archive_members(Context &ctx) {
+    std::vector<ObjectFile *> files;
+    for (InputFile *file : ctx.files)
+        files.push_back(static_cast<ObjectFile *>(file));
+
+    while (!files.empty()) {
+        tbb::concurrent_vector<ObjectFile *> extracted;
+        tbb::parallel_for_each(files, [&](ObjectFile *file) {
+            for (u32 i = 0; i < file->symbols.size(); i++) {
+                // As in other linkers, weak references do not extract
+                // archive members.
+                WasmSymbol &wsym = file->symbols[i];
+                if (wsym.is_defined() || wsym.is_binding_weak())
+                    continue;
+
+                Symbol *sym = file->syms[i];
+                if (sym->is_defined())
+                    continue;
+                ObjectFile *member = find_archive_member(ctx, sym->name);
+                if (member && !member->is_alive.exchange(true))
+                    extracted.push_back(member);
+            }
+        });
+
+        files.assign(extracted.begin(), extracted.end());
+        std::sort(files.begin(), files.end(), [](ObjectFile *a, ObjectFile *b) {
+            return a->priority < b->priority;
+        });
+
+        tbb::parallel_for_each(files, [&](ObjectFile *file) {
+            Debug(ctx, DEBUG_INPUT) << "extract " << file->filename;
+            file->parse(ctx);
+            file->resolve_symbols(ctx);
+        });
+        ctx.files.insert(ctx.files.end(), files.begin(), files.end());
+    }
+
+    // Keep files in command-line order regardless of when they were
+    // extracted.
+    std::stable_sort(ctx.files.begin(), ctx.files.end(),
+                     [](InputFile *a, InputFile *b) {
+                         return a->priority < b->priority;
+                     });
+}
+
 void resolve_symbols(Context &ctx) {
+    // Size the symbol table up front so that it rarely has to chain
+    // additional tables. Most names are shared by several files, so this
+    // over-estimates, which only costs untouched zero pages.
+    i64 num_symbols = 0;
+    for (InputFile *file : ctx.files)
+        num_symbols += file->symbols.size();
+    ctx.symbol_map.reserve(num_symbols);
+
     // Add symbols to the global symbol table
     tbb::parallel_for_each(
         ctx.files, [&](InputFile *file) { file->resolve_symbols(ctx); });
+
+    if (!ctx.archives.empty())
+        extract_archive_members(ctx);
+}
+
+// Keeps one copy of each COMDAT group, the one in the file with the
+// lowest priority, and kills the functions and data segments of the other
+// copies. Their relocations are never applied since dead fragments are
+// not laid out.
+void eliminate_comdats(Context &ctx) {
+    tbb::parallel_for_each(ctx.files, [&](InputFile *file) {
+        ObjectFile *obj = static_cast<ObjectFile *>(file);
+        for (ComdatGroupRef &ref : obj->comdat_groups)
+            update_minimum(ref.group->owner, obj->priority);
+    });
+
+    tbb::parallel_for_each(ctx.files, [&](InputFile *file) {
+        ObjectFile *obj = static_cast<ObjectFile *>(file);
+        for (ComdatGroupRef &ref : obj->comdat_groups) {
+            if (ref.group->owner == obj->priority)
+                continue;
+            for (u32 index : ref.functions)
+                obj->get_function_code(index)->is_alive = false;
+            for (u32 index : ref.data_segments)
+                obj->data_ifrags[index]->is_alive = false;
+        }
+    });
 }
 
 void check_undefined(Context &ctx) {
-    Debug(ctx) << "Checking undefined symbols";
-    tbb::parallel_for_each(ctx.symbol_map, [&](auto &pair) {
-        Symbol &sym = pair.second;
+    Debug(ctx, DEBUG_SYMBOL) << "Checking undefined symbols";
+    ctx.symbol_map.for_each([&](Symbol &sym) {
+        // Skip symbols which no live file has resolved.
+        if (!sym.wsym.has_value())
+            return;
         if (sym.is_defined())
             return;
 
@@ -39,35 +140,70 @@ void check_undefined(Context &ctx) {
     });
 }
 
+// Concatenates per-file vectors in file order. The offset of each vector
+// in the result is the prefix sum of the sizes of the preceding ones, so
+// the copies can run in parallel.
+template <typename T>
+static void append_in_order(std::vector<T> &out,
+                            const std::vector<std::vector<T>> &vecs) {
+    std::vector<size_t> offsets(vecs.size() + 1);
+    offsets[0] = out.size();
+    for (size_t i = 0; i < vecs.size(); i++)
+        offsets[i + 1] = offsets[i] + vecs[i].size();
+
+    out.resize(offsets.back());
+    tbb::parallel_for((size_t)0, vecs.size(), [&](size_t i) {
+        std::copy(vecs[i].begin(), vecs[i].end(), out.begin() + offsets[i]);
+    });
+}
+
 void calculate_imports(Context &ctx) {
-    // resolve all undefined symbols
-    // cannot parallelize because of pushing to output imports
-    std::mutex m;
-    tbb::parallel_for_each(ctx.files, [&](InputFile *file) {
+    // Collect undefined symbols per file, then import each symbol at the
+    // position of its first reference so that the order is reproducible.
+    std::vector<std::vector<Symbol *>> funcs(ctx.files.size());
+    std::vector<std::vector<Symbol *>> globals(ctx.files.size());
+
+    tbb::parallel_for((size_t)0, ctx.files.size(), [&](size_t file_idx) {
+        InputFile *file = ctx.files[file_idx];
         if (file->kind != InputFile::Object)
             return;
 
         ObjectFile *obj = static_cast<ObjectFile *>(file);
-        for (auto wsym : obj->symbols) {
+        for (u32 i = 0; i < obj->symbols.size(); i++) {
+            WasmSymbol &wsym = obj->symbols[i];
             if (wsym.is_type_data())
                 continue;
             if (wsym.is_binding_weak())
                 continue;
             if (wsym.is_binding_local())
                 continue;
-            Symbol *sym = get_symbol(ctx, wsym.info.name);
+            Symbol *sym = obj->syms[i];
             if (sym->is_defined())
                 continue;
+            if (ctx.arg.gc_sections && !sym->is_alive)
+                continue;
 
             if (wsym.is_type_function()) {
-                ctx.import_functions.insert(sym);
+                funcs[file_idx].push_back(sym);
             } else if (wsym.is_type_global()) {
-                ctx.import_globals.insert(sym);
+                globals[file_idx].push_back(sym);
             } else {
                 Error(ctx) << "TODO: import symbol type: " << wsym.info.kind;
             }
         }
     });
+
+    // The number of imports is small, so deduplicate them serially.
+    auto add = [](std::vector<Symbol *> &out,
+                  const std::vector<std::vector<Symbol *>> &vecs) {
+        std::unordered_set<Symbol *> seen;
+        for (const std::vector<Symbol *> &vec : vecs)
+            for (Symbol *sym : vec)
+                if (seen.insert(sym).second)
+                    out.push_back(sym);
+    };
+    add(ctx.import_functions, funcs);
+    add(ctx.import_globals, globals);
 }
 
 static void
@@ -140,8 +276,8 @@ void create_internal_file(Context &ctx) {
         {
             // Dummy content.
             static std::vector<u8> dummy = {0x00, WASM_OPCODE_END};
-            ctx.__wasm_call_ctors = new InputFragment(0, obj, dummy, 0);
-            ctx.ifrag_pool.emplace_back(ctx.__wasm_call_ctors);
+            ctx.__wasm_call_ctors =
+                obj->arena.create<InputFragment>(0, obj, dummy, 0);
             obj->code_ifrags.emplace_back(ctx.__wasm_call_ctors);
         }
         obj->symbols.push_back(wsym);
@@ -173,19 +309,37 @@ void create_synthetic_sections(Context &ctx) {
     push(ctx.name = new NameSection());
 }
 
+namespace {
+// Definitions contributed by one file
+struct Definitions {
+    std::vector<Symbol *> functions;
+    std::vector<Symbol *> folded_functions;
+    std::vector<Symbol *> globals;
+    std::vector<Symbol *> data_symbols;
+    std::vector<Symbol *> export_functions;
+    std::vector<Symbol *> export_globals;
+    std::vector<Symbol *> export_datas;
+};
+} // namespace
+
 void add_definitions(Context &ctx) {
-    tbb::parallel_for_each(ctx.files, [&](InputFile *file) {
+    std::vector<Definitions> defs(ctx.files.size());
+
+    tbb::parallel_for((size_t)0, ctx.files.size(), [&](size_t file_idx) {
+        InputFile *file = ctx.files[file_idx];
         if (file->kind != InputFile::Object)
             return;
 
         ObjectFile *obj = static_cast<ObjectFile *>(file);
+        Definitions &def = defs[file_idx];
 
         // Encode symbol definiton as (symbol type, index) because a symbol
         // table in a object file may contain multiple symbols refering to the
         // same item.
         std::set<std::pair<WasmSymbolType, u32>> visited;
-        for (auto &wsym : obj->symbols) {
-            Debug(ctx) << "Adding definition: " << wsym.info.name;
+        for (u32 i = 0; i < obj->symbols.size(); i++) {
+            WasmSymbol &wsym = obj->symbols[i];
+            Debug(ctx, DEBUG_SYMBOL) << "Adding definition: " << wsym.info.name;
             // if (wsym.is_binding_local())
             //     continue;
             if (wsym.is_undefined())
@@ -194,23 +348,57 @@ void add_definitions(Context &ctx) {
                      .second)
                 continue;
 
-            Symbol *sym = get_symbol(ctx, wsym.info.name);
+            // The definition was overridden by another file.
+            Symbol *sym = obj->syms[i];
+            if (sym->file != obj)
+                continue;
+
+            // Folded into another function by --icf. It is not emitted, but
+            // it is still exported under its own name.
+            if (sym->ifrag && sym->ifrag->leader) {
+                def.folded_functions.push_back(sym);
+                if (should_export_symbol(ctx, sym))
+                    def.export_functions.push_back(sym);
+                continue;
+            }
+
+            // Removed by --gc-sections
+            if (sym->ifrag && !sym->ifrag->is_alive)
+                continue;
+            if (wsym.is_type_global() && ctx.arg.gc_sections &&
+                !sym->is_alive)
+                continue;
 
             if (wsym.is_type_function()) {
-                ctx.functions.push_back(sym);
+                def.functions.push_back(sym);
                 if (should_export_symbol(ctx, sym))
-                    ctx.export_functions.push_back(sym);
+                    def.export_functions.push_back(sym);
             } else if (wsym.is_type_global()) {
-                ctx.globals.push_back(sym);
+                def.globals.push_back(sym);
                 if (should_export_symbol(ctx, sym))
-                    ctx.export_globals.push_back(sym);
+                    def.export_globals.push_back(sym);
             } else if (wsym.is_type_data()) {
-                ctx.data_symbols.push_back(sym);
+                def.data_symbols.push_back(sym);
                 if (should_export_symbol(ctx, sym))
-                    ctx.export_datas.push_back(sym);
+                    def.export_datas.push_back(sym);
             }
         }
     });
+
+    auto collect = [&](std::vector<Symbol *> &out,
+                       std::vector<Symbol *> Definitions::*member) {
+        std::vector<std::vector<Symbol *>> vecs(defs.size());
+        for (size_t i = 0; i < defs.size(); i++)
+            vecs[i] = std::move(defs[i].*member);
+        append_in_order(out, vecs);
+    };
+    collect(ctx.functions, &Definitions::functions);
+    collect(ctx.folded_functions, &Definitions::folded_functions);
+    collect(ctx.globals, &Definitions::globals);
+    collect(ctx.data_symbols, &Definitions::data_symbols);
+    collect(ctx.export_functions, &Definitions::export_functions);
+    collect(ctx.export_globals, &Definitions::export_globals);
+    collect(ctx.export_datas, &Definitions::export_datas);
 }
 
 void assign_index(Context &ctx) {
@@ -235,25 +423,127 @@ void assign_index(Context &ctx) {
                       [&](std::size_t i) {
                           ctx.globals[i]->index = i + ctx.import_globals.size();
                       });
+
+    if (!ctx.folded_functions.empty()) {
+        std::unordered_map<InputFragment *, u32> leader_index;
+        for (Symbol *sym : ctx.functions)
+            leader_index[sym->ifrag] = sym->index;
+        tbb::parallel_for_each(ctx.folded_functions, [&](Symbol *sym) {
+            sym->index = leader_index.at(sym->ifrag->leader);
+        });
+    }
+}
+
+// Serializes a signature so that equal signatures have equal keys.
+static std::string get_signature_key(const WasmSignature &sig) {
+    std::string key;
+    key.reserve(sig.params.size() + sig.returns.size() + 1);
+    key.append(sig.params.begin(), sig.params.end());
+    // Not a valid type, so it separates params from returns.
+    key.push_back(0);
+    key.append(sig.returns.begin(), sig.returns.end());
+    return key;
 }
 
+namespace {
+struct TypeEntry {
+    TypeEntry(const WasmSignature *sig) : sig(sig) {}
+
+    const WasmSignature *sig;
+    // The smallest position at which this signature is used. Entries
+    // are sorted by this to get indices that do not depend on which
+    // thread inserted them first.
+    std::atomic<u64> first_use = UINT64_MAX;
+    u32 index = 0;
+};
+} // namespace
+
+// Builds the output type section with one entry per distinct signature.
+// Signatures are interned in a concurrent hash map in parallel, and
+// indices are assigned in the order of first use: imported functions and
+// defined functions in index order, then types referenced by
+// R_WASM_TYPE_INDEX_LEB (call_indirect) in file order.
 void calculate_types(Context &ctx) {
-    for (Symbol *sym : ctx.import_functions) {
-        ASSERT(sym->wsym.has_value());
-        const WasmSignature *sig = sym->wsym.value().signature;
-        sym->sig_index = ctx.signatures.size();
-        ctx.signatures.push_back(*sig);
-    }
-    for (Symbol *sym : ctx.functions) {
-        ASSERT(sym->wsym.has_value());
-        const WasmSignature *sig = sym->wsym.value().signature;
-        sym->sig_index = ctx.signatures.size();
-        ctx.signatures.push_back(*sig);
+    ConcurrentMap<TypeEntry> map;
+
+    auto intern = [&](const WasmSignature &sig, const std::string &key,
+                      u64 pos) {
+        TypeEntry *ent = map.insert(key, hash_string(key), &sig).first;
+        update_minimum(ent->first_use, pos);
+    };
+
+    std::vector<Symbol *> funcs(ctx.import_functions.begin(),
+                                ctx.import_functions.end());
+    funcs.insert(funcs.end(), ctx.functions.begin(), ctx.functions.end());
+    std::vector<std::string> func_keys(funcs.size());
+
+    tbb::parallel_for((size_t)0, funcs.size(), [&](size_t i) {
+        ASSERT(funcs[i]->wsym.has_value());
+        const WasmSignature &sig = *funcs[i]->wsym->signature;
+        func_keys[i] = get_signature_key(sig);
+        intern(sig, func_keys[i], funcs[i]->index);
+    });
+
+    // Keys of all signatures of each file. The map refers to them, so they
+    // must outlive it.
+    std::vector<std::vector<std::string>> file_keys(ctx.files.size());
+
+    tbb::parallel_for((size_t)0, ctx.files.size(), [&](size_t i) {
+        ObjectFile *obj = static_cast<ObjectFile *>(ctx.files[i]);
+        for (const WasmSignature &sig : obj->signatures)
+            file_keys[i].push_back(get_signature_key(sig));
+
+        for (InputFragment *ifrag : obj->code_ifrags) {
+            if (!ifrag->is_alive)
+                continue;
+            for (WasmRelocation &reloc : ifrag->relocs) {
+                if (reloc.type != R_WASM_TYPE_INDEX_LEB)
+                    continue;
+                if (reloc.index >= obj->signatures.size())
+                    Fatal(ctx) << obj->filename << ": type index "
+                               << reloc.index << " is out of range";
+                intern(obj->signatures[reloc.index], file_keys[i][reloc.index],
+                       ((u64)(i + 1) << 32) | reloc.index);
+            }
+        }
+    });
+
+    tbb::concurrent_vector<TypeEntry *> entries;
+    map.for_each([&](TypeEntry &ent) { entries.push_back(&ent); });
+
+    std::vector<TypeEntry *> sorted(entries.begin(), entries.end());
+    std::sort(sorted.begin(), sorted.end(), [](TypeEntry *a, TypeEntry *b) {
+        return a->first_use < b->first_use;
+    });
+
+    ctx.signatures.clear();
+    for (TypeEntry *ent : sorted) {
+        ent->index = ctx.signatures.size();
+        ctx.signatures.push_back(*ent->sig);
     }
+
+    tbb::parallel_for((size_t)0, funcs.size(), [&](size_t i) {
+        const std::string &key = func_keys[i];
+        funcs[i]->sig_index = map.find(key, hash_string(key))->index;
+    });
+
+    tbb::parallel_for((size_t)0, ctx.files.size(), [&](size_t i) {
+        ObjectFile *obj = static_cast<ObjectFile *>(ctx.files[i]);
+        obj->type_indices.resize(obj->signatures.size());
+        for (u32 j = 0; j < obj->signatures.size(); j++) {
+            const std::string &key = file_keys[i][j];
+            TypeEntry *ent = map.find(key, hash_string(key));
+            obj->type_indices[j] = ent ? ent->index : 0;
+        }
+    });
+
+    Debug(ctx, DEBUG_LAYOUT) << "types: " << ctx.signatures.size()
+                             << " distinct signatures for " << funcs.size()
+                             << " functions";
 }
 
 void setup_ctors(Context &ctx) {
-    Debug(ctx) << "Setting up ctors";
+    Debug(ctx, DEBUG_SYMBOL) << "Setting up ctors";
     // Priority -> ctors
     std::map<u32, std::vector<Symbol *>, std::greater<u32>> map;
     for (Symbol *f : ctx.functions) {
@@ -261,12 +551,12 @@ void setup_ctors(Context &ctx) {
             continue;
         if (!f->wsym.value().info.init_func_priority.has_value())
             continue;
-        Debug(ctx) << "ctor: " << f->name;
+        Debug(ctx, DEBUG_SYMBOL) << "ctor: " << f->name;
         u32 priority = f->wsym.value().info.init_func_priority.value();
         map[priority].push_back(f);
     }
 
-    static std::stringstream s;
+    std::stringstream s;
     s << (u8)0x00; // no locals
     for (auto &[priority, ctors] : map) {
         for (Symbol *f : ctors) {
@@ -275,52 +565,77 @@ void setup_ctors(Context &ctx) {
         }
     }
     s << (u8)WASM_OPCODE_END;
+    std::string_view body = save_string(ctx, s.str());
     ctx.__wasm_call_ctors->span =
-        std::span<const u8>{(const u8 *)s.view().data(), s.view().size()};
+        std::span<const u8>{(const u8 *)body.data(), body.size()};
 }
 
 void setup_indirect_functions(Context &ctx) {
     // __indirect_function_table
     ctx.__indirect_function_table = OutputElem{ValType(WASM_TYPE_FUNCREF)};
     ctx.__indirect_function_table.flags = 0;
-    tbb::parallel_for_each(ctx.files, [&](InputFile *file) {
+
+    // Collect elements per file and concatenate them in file order
+    std::vector<std::vector<Symbol *>> elements(ctx.files.size());
+    tbb::parallel_for((size_t)0, ctx.files.size(), [&](size_t file_idx) {
+        InputFile *file = ctx.files[file_idx];
         if (file->kind != InputFile::Object)
             return;
         ObjectFile *obj = static_cast<ObjectFile *>(file);
 
-        for (InputSection *isec : obj->sections) {
-            for (auto &reloc : isec->relocs) {
+        auto add_elements = [&](InputFragment *ifrag) {
+            if (!ifrag->is_alive)
+                return;
+            for (auto &reloc : ifrag->relocs) {
                 switch (reloc.type) {
                 case R_WASM_TABLE_INDEX_I32:
                 case R_WASM_TABLE_INDEX_I64:
                 case R_WASM_TABLE_INDEX_SLEB:
-                case R_WASM_TABLE_INDEX_SLEB64: {
-                    std::string &name = obj->symbols[reloc.index].info.name;
-                    Symbol *sym = get_symbol(ctx, name);
-                    if (sym->is_defined()) {
-                        ctx.__indirect_function_table.elements.emplace_back(
-                            sym);
-                    }
+                case R_WASM_TABLE_INDEX_SLEB64:
+                case R_WASM_TABLE_INDEX_REL_SLEB:
+                case R_WASM_TABLE_INDEX_REL_SLEB64: {
+                    // Undefined weak functions have no address and
+                    // are null instead.
+                    Symbol *sym = obj->syms[reloc.index];
+                    if (sym->is_defined() ||
+                        sym->binding != Symbol::Binding::Weak)
+                        elements[file_idx].push_back(sym);
                 } break;
                 default:
                     break;
                 }
             }
-        }
+        };
+
+        for (InputFragment *ifrag : obj->code_ifrags)
+            add_elements(ifrag);
+        for (InputFragment *ifrag : obj->data_ifrags)
+            add_elements(ifrag);
     });
+    append_in_order(ctx.__indirect_function_table.elements, elements);
+
+    // A function whose address is taken more than once gets one element.
+    std::vector<Symbol *> &table = ctx.__indirect_function_table.elements;
+    u32 num_elements = 0;
+    for (Symbol *sym : table) {
+        if (sym->table_index)
+            continue;
+        sym->table_index = kTableBase + num_elements;
+        table[num_elements++] = sym;
+    }
+    table.resize(num_elements);
 
     ASSERT(ctx.tables.empty());
     ctx.tables.push_back(WasmTableType{
         .elem_type = ValType(WASM_TYPE_FUNCREF),
         .limits = WasmLimits{
             .flags = 0,
-            // TODO: reserve the first index maybe??
-            .minimum = ctx.__indirect_function_table.elements.size() + 1,
+            .minimum = kTableBase + num_elements,
             .maximum = 0}});
 }
 
 void setup_memory(Context &ctx) {
-    Debug(ctx) << "Setting up memory layout";
+    Debug(ctx, DEBUG_LAYOUT) << "Setting up memory layout";
     i32 offset = 0;
     const u32 memory_size = kPageSize * kMinMemoryPages;
     {
@@ -336,42 +651,27 @@ void setup_memory(Context &ctx) {
     // TODO: __memory_base
     // TODO: __table_base
 
-    // merge data fragments
+    // merge live data segments into output segments in input order
     for (InputFile *file : ctx.files) {
         if (file->kind != InputFile::Object)
-            return;
+            continue;
         ObjectFile *obj = static_cast<ObjectFile *>(file);
 
-        // merge data segments
-        for (auto &wsym : obj->symbols) {
-            if (wsym.is_binding_local())
-                continue;
-            if (wsym.is_undefined())
-                continue;
-            if (!wsym.is_type_data())
+        for (u32 i = 0; i < obj->data_ifrags.size(); i++) {
+            InputFragment *ifrag = obj->data_ifrags[i];
+            if (!ifrag->is_alive)
                 continue;
-
-            // Get a global symbol and the segment where it resides
-            u32 seg_index = wsym.info.value.data_ref.segment;
-            // data segment
-            const WasmDataSegment &seg = obj->data_segments[seg_index];
-            auto oseg = OutputSegment::get_or_create(ctx, seg.name);
-            auto frag_offset = oseg->get_frag_offset(wsym.info.name);
-            if (frag_offset.has_value())
-                return;
-            else {
-                InputFragment *seg_ifrag = obj->data_ifrags[seg_index];
-                oseg->merge(ctx, seg, seg_ifrag);
-            }
+            const WasmDataSegment &seg = obj->data_segments[i];
+            OutputSegment::get_or_create(ctx, seg.name)->merge(ctx, seg, ifrag);
         }
     }
 
     // assign offset to segments
     for (auto &[name, seg] : ctx.segments) {
-        offset = align(offset, seg.p2align);
+        offset = align(offset, 1 << seg.p2align);
         seg.set_virtual_address(offset);
-        Debug(ctx) << "Segment: " << name << " offset: 0x" << offset
-                   << " size: 0x" << seg.get_size();
+        Debug(ctx, DEBUG_LAYOUT) << "Segment: " << name << " offset: 0x"
+                                 << offset << " size: 0x" << seg.get_size();
         offset += seg.get_size();
     }
 
@@ -381,25 +681,26 @@ void setup_memory(Context &ctx) {
             return;
         ObjectFile *obj = static_cast<ObjectFile *>(file);
 
-        for (auto &wsym : obj->symbols) {
-            if (wsym.is_binding_local())
-                continue;
+        for (u32 i = 0; i < obj->symbols.size(); i++) {
+            WasmSymbol &wsym = obj->symbols[i];
             if (wsym.is_undefined())
                 continue;
             if (!wsym.is_type_data())
                 continue;
 
+            Symbol *sym = obj->syms[i];
+            if (sym->file != obj || !sym->ifrag || !sym->ifrag->is_alive)
+                continue;
+
             u32 seg_index = wsym.info.value.data_ref.segment;
             const WasmDataSegment &seg = obj->data_segments[seg_index];
             auto oseg = OutputSegment::get_or_create(ctx, seg.name);
             i32 oseg_va = oseg->get_virtual_address();
-            i32 frag_offset = oseg->get_frag_offset(seg.name).value();
 
-            Symbol *sym = get_symbol(ctx, wsym.info.name);
-            sym->virtual_address =
-                oseg_va + frag_offset + wsym.info.value.data_ref.offset;
-            Debug(ctx) << "Data symbol: " << sym->name << " va: 0x"
-                       << sym->virtual_address;
+            sym->virtual_address = oseg_va + sym->ifrag->seg_offset +
+                                   wsym.info.value.data_ref.offset;
+            Debug(ctx, DEBUG_LAYOUT) << "Data symbol: " << sym->name
+                                     << " va: 0x" << sym->virtual_address;
         }
     });
 
@@ -430,16 +731,17 @@ u64 compute_section_sizes(Context &ctx) {
     for (Chunk *chunk : ctx.chunks) {
         chunk->loc.offset = offset;
         offset += chunk->loc.size;
-        Debug(ctx) << std::hex << "Section: " << chunk->name << " offset: 0x"
-                   << chunk->loc.offset << " size: 0x" << chunk->loc.size;
+        Debug(ctx, DEBUG_LAYOUT)
+            << std::hex << "Section: " << chunk->name << " offset: 0x"
+            << chunk->loc.offset << " size: 0x" << chunk->loc.size;
     }
-    Debug(ctx) << std::hex << "Total size: 0x" << offset;
+    Debug(ctx, DEBUG_LAYOUT) << std::hex << "Total size: 0x" << offset;
     return offset;
 }
 
 void copy_chunks(Context &ctx) {
     tbb::parallel_for_each(ctx.chunks, [&](Chunk *chunk) {
-        Debug(ctx) << "Copying chunk: " << chunk->name;
+        Debug(ctx, DEBUG_OUTPUT) << "Copying chunk: " << chunk->name;
         chunk->copy_buf(ctx);
     });
 }
@@ -449,4 +751,21 @@ void apply_reloc(Context &ctx) {
                            [&](Chunk *chunk) { chunk->apply_reloc(ctx); });
 }
 
+void print_stats(Context &ctx) {
+    auto stats = ctx.symbol_map.get_stats();
+    double avg_probe =
+        stats.num_entries ? (double)stats.total_probes / stats.num_entries : 0;
+
+    SyncOut(ctx) << "symbol table: " << stats.num_entries << " symbols, "
+                 << stats.capacity << " slots in " << stats.num_tables
+                 << " tables";
+    SyncOut(ctx) << "symbol table: probes avg=" << avg_probe
+                 << " max=" << stats.max_probe;
+    SyncOut(ctx) << "symbol table: contention cas_failures="
+                 << stats.num_cas_failures << " waits=" << stats.num_waits;
+    if (!ctx.arg.cache_dir.empty() || ctx.resident)
+        SyncOut(ctx) << "parse cache: hits=" << ctx.num_cache_hits
+                     << " misses=" << ctx.num_cache_misses;
+}
+
 } // namespace xld::wasm
@@ -0,0 +1,477 @@
+// This file applies relocations to the output.
+//
+// Each relocation type is handled by its own instance of apply_kernel(),
+// which is found through a table indexed by type and applied to a run of
+// relocations of that type. The value a type computes and the way it is
+// encoded are both known at compile time, so applying a relocation is a
+// lookup of the resolved value followed by a store of a fixed number of
+// bytes. There is no switch over types and no loop over LEB128 bytes on
+// the hot path.
+//
+// The bytes being relocated are always padded to their full width by the
+// compiler, so they can be overwritten in place:
+//
+//   5 bytes for LEB/SLEB, 10 bytes for LEB64/SLEB64,
+//   4 bytes for I32 and 8 bytes for I64.
+//
+// With --compress-relocations, function bodies are instead rewritten
+// before layout with each relocated LEB in its minimal width. This makes
+// call-heavy code noticeably smaller, at the cost of a copy of each body.
+//
+// Relocations are applied to code and data. Custom sections are not
+// copied to the output, so their relocations (reloc.<custom>) are not
+// supported yet.
+//
+// https://github.com/WebAssembly/tool-conventions/blob/main/Linking.md
+
+#include "common/leb128.h"
+#include "common/log.h"
+#include "oneapi/tbb/parallel_for.h"
+#include "pass.h"
+#include "wasm/object.h"
+#include "xld.h"
+#include <array>
+
+namespace xld::wasm {
+
+#define WASM_RELOC(x, y)                                                       \
+    case (x):                                                                  \
+        return (#x);
+
+std::string_view get_reloc_type_name(u8 type) {
+    switch (type) {
+#include "wasm/wasm_relocs.def"
+    default:
+        return "<unknown>";
+    }
+}
+
+#undef WASM_RELOC
+
+namespace {
+enum class RelocValue {
+    TypeIndex,
+    SymbolIndex,
+    TableIndex,
+    TableIndexRel,
+    TableNumber,
+    TagIndex,
+    MemoryAddr,
+    MemoryAddrTls,
+    MemoryAddrLocrel,
+    FunctionOffset,
+    SectionOffset,
+};
+
+enum class RelocEncoding {
+    ULEB5,
+    SLEB5,
+    ULEB10,
+    SLEB10,
+    I32,
+    I64,
+};
+
+struct RelocInfo {
+    RelocValue value;
+    RelocEncoding encoding;
+};
+
+// The bytes a list of relocations is applied to
+struct RelocTarget {
+    ObjectFile *obj;
+    // Output location of the byte at offset `in_offset` of the section
+    u8 *base;
+    u64 in_offset;
+    // Virtual address of the byte at `in_offset`, if it is in memory
+    std::optional<u32> va;
+};
+} // namespace
+
+static constexpr RelocInfo get_reloc_info(u8 type) {
+    using V = RelocValue;
+    using E = RelocEncoding;
+
+    switch (type) {
+    case R_WASM_FUNCTION_INDEX_LEB:
+        return {V::SymbolIndex, E::ULEB5};
+    case R_WASM_TABLE_INDEX_SLEB:
+        return {V::TableIndex, E::SLEB5};
+    case R_WASM_TABLE_INDEX_I32:
+        return {V::TableIndex, E::I32};
+    case R_WASM_MEMORY_ADDR_LEB:
+        return {V::MemoryAddr, E::ULEB5};
+    case R_WASM_MEMORY_ADDR_SLEB:
+        return {V::MemoryAddr, E::SLEB5};
+    case R_WASM_MEMORY_ADDR_I32:
+        return {V::MemoryAddr, E::I32};
+    case R_WASM_TYPE_INDEX_LEB:
+        return {V::TypeIndex, E::ULEB5};
+    case R_WASM_GLOBAL_INDEX_LEB:
+        return {V::SymbolIndex, E::ULEB5};
+    case R_WASM_FUNCTION_OFFSET_I32:
+        return {V::FunctionOffset, E::I32};
+    case R_WASM_SECTION_OFFSET_I32:
+        return {V::SectionOffset, E::I32};
+    case R_WASM_TAG_INDEX_LEB:
+        return {V::TagIndex, E::ULEB5};
+    case R_WASM_MEMORY_ADDR_REL_SLEB:
+        // Memory starts at __memory_base = 0, so relative and absolute
+        // addresses are the same.
+        return {V::MemoryAddr, E::SLEB5};
+    case R_WASM_TABLE_INDEX_REL_SLEB:
+        return {V::TableIndexRel, E::SLEB5};
+    case R_WASM_GLOBAL_INDEX_I32:
+        return {V::SymbolIndex, E::I32};
+    case R_WASM_MEMORY_ADDR_LEB64:
+        return {V::MemoryAddr, E::ULEB10};
+    case R_WASM_MEMORY_ADDR_SLEB64:
+        return {V::MemoryAddr, E::SLEB10};
+    case R_WASM_MEMORY_ADDR_I64:
+        return {V::MemoryAddr, E::I64};
+    case R_WASM_MEMORY_ADDR_REL_SLEB64:
+        return {V::MemoryAddr, E::SLEB10};
+    case R_WASM_TABLE_INDEX_SLEB64:
+        return {V::TableIndex, E::SLEB10};
+    case R_WASM_TABLE_INDEX_I64:
+        return {V::TableIndex, E::I64};
+    case R_WASM_TABLE_NUMBER_LEB:
+        return {V::TableNumber, E::ULEB5};
+    case R_WASM_MEMORY_ADDR_TLS_SLEB:
+        return {V::MemoryAddrTls, E::SLEB5};
+    case R_WASM_FUNCTION_OFFSET_I64:
+        return {V::FunctionOffset, E::I64};
+    case R_WASM_MEMORY_ADDR_LOCREL_I32:
+        return {V::MemoryAddrLocrel, E::I32};
+    case R_WASM_TABLE_INDEX_REL_SLEB64:
+        return {V::TableIndexRel, E::SLEB10};
+    case R_WASM_MEMORY_ADDR_TLS_SLEB64:
+        return {V::MemoryAddrTls, E::SLEB10};
+    case R_WASM_FUNCTION_INDEX_I32:
+        return {V::SymbolIndex, E::I32};
+    }
+    unreachable();
+}
+
+template <RelocValue V>
+static i64 get_value(Context &ctx, const RelocTarget &t,
+                     const WasmRelocation &rel) {
+    // The index of R_WASM_TYPE_INDEX_LEB is a type index of the object
+    // file, not a symbol index.
+    if constexpr (V == RelocValue::TypeIndex)
+        return t.obj->type_indices[rel.index];
+
+    Symbol *sym = t.obj->syms[rel.index];
+
+    if constexpr (V == RelocValue::SymbolIndex)
+        return sym->index;
+
+    // Undefined weak functions are null.
+    if constexpr (V == RelocValue::TableIndex)
+        return sym->table_index;
+    if constexpr (V == RelocValue::TableIndexRel)
+        return sym->table_index ? sym->table_index - kTableBase : 0;
+
+    // __indirect_function_table is the only table in the output.
+    if constexpr (V == RelocValue::TableNumber) {
+        if (sym->name != "__indirect_function_table")
+            Error(ctx) << t.obj->filename << ": unsupported table: "
+                       << sym->name;
+        return 0;
+    }
+
+    if constexpr (V == RelocValue::TagIndex) {
+        Error(ctx) << t.obj->filename
+                   << ": exception tags are not supported: " << sym->name;
+        return 0;
+    }
+
+    // Undefined weak data symbols are at address 0.
+    if constexpr (V == RelocValue::MemoryAddr)
+        return sym->is_defined() ? sym->virtual_address + rel.addend : 0;
+
+    // Thread-local symbols are addressed relative to the start of their
+    // segment.
+    if constexpr (V == RelocValue::MemoryAddrTls) {
+        if (!sym->is_defined() || !sym->ifrag)
+            return 0;
+        return sym->ifrag->seg_offset +
+               sym->wsym->info.value.data_ref.offset + rel.addend;
+    }
+
+    if constexpr (V == RelocValue::MemoryAddrLocrel) {
+        if (!t.va) {
+            Error(ctx) << t.obj->filename
+                       << ": R_WASM_MEMORY_ADDR_LOCREL_I32 is only allowed "
+                          "in data segments";
+            return 0;
+        }
+        i64 place = *t.va + (rel.offset - t.in_offset);
+        i64 addr = sym->is_defined() ? sym->virtual_address + rel.addend : 0;
+        return addr - place;
+    }
+
+    // Offset of a function body from the start of the code section
+    if constexpr (V == RelocValue::FunctionOffset) {
+        InputFragment *ifrag = sym->ifrag;
+        if (!sym->is_defined() || !ifrag)
+            return 0;
+        if (ifrag->leader)
+            ifrag = ifrag->leader;
+        return ifrag->out_offset + rel.addend;
+    }
+
+    // Custom sections are not copied to the output, so there is no
+    // section to refer to.
+    if constexpr (V == RelocValue::SectionOffset) {
+        Error(ctx) << t.obj->filename
+                   << ": R_WASM_SECTION_OFFSET_I32 is not supported";
+        return 0;
+    }
+}
+
+template <int N>
+static void write_uleb(u8 *loc, u64 val) {
+    for (int i = 0; i < N - 1; i++) {
+        loc[i] = (val & 0x7f) | 0x80;
+        val >>= 7;
+    }
+    loc[N - 1] = val & 0x7f;
+}
+
+template <int N>
+static void write_sleb(u8 *loc, i64 val) {
+    for (int i = 0; i < N - 1; i++) {
+        loc[i] = (val & 0x7f) | 0x80;
+        val >>= 7;
+    }
+    loc[N - 1] = val & 0x7f;
+}
+
+template <RelocEncoding E>
+static constexpr u32 get_width() {
+    switch (E) {
+    case RelocEncoding::ULEB5:
+    case RelocEncoding::SLEB5:
+        return 5;
+    case RelocEncoding::ULEB10:
+    case RelocEncoding::SLEB10:
+        return 10;
+    case RelocEncoding::I32:
+        return 4;
+    case RelocEncoding::I64:
+        return 8;
+    }
+}
+
+template <RelocEncoding E>
+static bool is_in_range(i64 val) {
+    switch (E) {
+    case RelocEncoding::ULEB5:
+        return 0 <= val && val <= UINT32_MAX;
+    case RelocEncoding::SLEB5:
+        return INT32_MIN <= val && val <= INT32_MAX;
+    case RelocEncoding::ULEB10:
+        return 0 <= val;
+    case RelocEncoding::SLEB10:
+        return true;
+    case RelocEncoding::I32:
+        return INT32_MIN <= val && val <= UINT32_MAX;
+    case RelocEncoding::I64:
+        return true;
+    }
+}
+
+// Writes `val` in the full width of the encoding.
+template <RelocEncoding E>
+static void write_value(u8 *loc, i64 val) {
+    switch (E) {
+    case RelocEncoding::ULEB5:
+        write_uleb<5>(loc, val);
+        break;
+    case RelocEncoding::SLEB5:
+        write_sleb<5>(loc, val);
+        break;
+    case RelocEncoding::ULEB10:
+        write_uleb<10>(loc, val);
+        break;
+    case RelocEncoding::SLEB10:
+        write_sleb<10>(loc, val);
+        break;
+    case RelocEncoding::I32: {
+        u32 v = val;
+        memcpy(loc, &v, sizeof(v));
+    } break;
+    case RelocEncoding::I64:
+        memcpy(loc, &val, sizeof(val));
+        break;
+    }
+}
+
+// Writes `val` in as few bytes as possible and returns the number of
+// bytes written. Only LEBs can be shortened.
+template <RelocEncoding E>
+static u32 write_value_min(u8 *loc, i64 val) {
+    switch (E) {
+    case RelocEncoding::ULEB5:
+    case RelocEncoding::ULEB10:
+        return encode_uleb128(val, loc);
+    case RelocEncoding::SLEB5:
+    case RelocEncoding::SLEB10:
+        return encode_sleb128(val, loc);
+    default:
+        write_value<E>(loc, val);
+        return get_width<E>();
+    }
+}
+
+template <u8 Type>
+static void report_out_of_range(Context &ctx, const RelocTarget &t, i64 val) {
+    Error(ctx) << t.obj->filename << ": relocation "
+               << get_reloc_type_name(Type) << " out of range: " << val;
+}
+
+// Applies the leading run of relocations of type `Type` and returns the
+// number of relocations consumed.
+template <u8 Type>
+static size_t apply_kernel(Context &ctx, const RelocTarget &t,
+                           std::span<const WasmRelocation> relocs) {
+    constexpr RelocInfo info = get_reloc_info(Type);
+    size_t i = 0;
+    for (; i < relocs.size() && relocs[i].type == Type; i++) {
+        const WasmRelocation &rel = relocs[i];
+        i64 val = get_value<info.value>(ctx, t, rel);
+        if (!is_in_range<info.encoding>(val))
+            report_out_of_range<Type>(ctx, t, val);
+        write_value<info.encoding>(t.base + (rel.offset - t.in_offset), val);
+
+        Debug(ctx, DEBUG_RELOC) << "- reloc " << get_reloc_type_name(Type)
+                                << " at 0x" << std::hex << rel.offset
+                                << " -> 0x" << val;
+    }
+    return i;
+}
+
+using RelocKernel = size_t (*)(Context &, const RelocTarget &,
+                               std::span<const WasmRelocation>);
+
+static constexpr std::array<RelocKernel, 256> reloc_kernels = [] {
+    std::array<RelocKernel, 256> kernels = {};
+#define WASM_RELOC(x, y) kernels[y] = apply_kernel<x>;
+#include "wasm/wasm_relocs.def"
+#undef WASM_RELOC
+    return kernels;
+}();
+
+bool is_known_reloc_type(u8 type) { return reloc_kernels[type]; }
+
+// Relocations stay sorted by offset, so that the output is written front
+// to back. Neighboring relocations usually share a type (e.g. a run of
+// calls), and each run is dispatched to its kernel once.
+static void apply_relocs(Context &ctx, const RelocTarget &t,
+                         std::span<const WasmRelocation> relocs) {
+    while (!relocs.empty())
+        relocs = relocs.subspan(reloc_kernels[relocs[0].type](ctx, t, relocs));
+}
+
+// Copies the relocated bytes to `out` in their minimal width and returns
+// the number of input bytes they replace.
+template <u8 Type>
+static u32 compress_kernel(Context &ctx, const RelocTarget &t,
+                           const WasmRelocation &rel, u8 *&out) {
+    constexpr RelocInfo info = get_reloc_info(Type);
+    i64 val = get_value<info.value>(ctx, t, rel);
+    if (!is_in_range<info.encoding>(val))
+        report_out_of_range<Type>(ctx, t, val);
+    out += write_value_min<info.encoding>(out, val);
+    return get_width<info.encoding>();
+}
+
+// Values that depend on the file layout or on the location being
+// relocated are not known before the code section is laid out.
+static constexpr bool is_layout_independent(RelocValue v) {
+    return v != RelocValue::FunctionOffset &&
+           v != RelocValue::MemoryAddrLocrel;
+}
+
+using CompressKernel = u32 (*)(Context &, const RelocTarget &,
+                               const WasmRelocation &, u8 *&);
+
+static constexpr std::array<CompressKernel, 256> compress_kernels = [] {
+    std::array<CompressKernel, 256> kernels = {};
+#define WASM_RELOC(x, y)                                                       \
+    if (is_layout_independent(get_reloc_info(y).value))                        \
+        kernels[y] = compress_kernel<x>;
+#include "wasm/wasm_relocs.def"
+#undef WASM_RELOC
+    return kernels;
+}();
+
+// Rewrites the body of `ifrag` into `buf` with relocations resolved and
+// returns false if the body cannot be rewritten before layout.
+static bool compress_body(Context &ctx, InputFragment *ifrag,
+                          std::vector<u8> &buf) {
+    for (const WasmRelocation &rel : ifrag->relocs)
+        if (!compress_kernels[rel.type])
+            return false;
+
+    // A relocated value never gets longer than its padded form.
+    buf.resize(ifrag->get_size());
+    RelocTarget t{.obj = ifrag->obj, .in_offset = ifrag->in_offset};
+    const u8 *in = ifrag->span.data();
+    u8 *out = buf.data();
+
+    for (const WasmRelocation &rel : ifrag->relocs) {
+        const u8 *loc = ifrag->span.data() + (rel.offset - ifrag->in_offset);
+        memcpy(out, in, loc - in);
+        out += loc - in;
+        in = loc + compress_kernels[rel.type](ctx, t, rel, out);
+    }
+    const u8 *end = ifrag->span.data() + ifrag->span.size();
+    memcpy(out, in, end - in);
+    out += end - in;
+
+    buf.resize(out - buf.data());
+    return true;
+}
+
+// Replaces function bodies with copies whose relocations are already
+// applied in minimal width. Sizes of the bodies change, so this runs
+// before the code section is laid out. Bodies whose relocations depend on
+// the layout are left as they are and relocated later.
+void compress_relocations(Context &ctx) {
+    ctx.compressed_bodies.resize(ctx.functions.size());
+    tbb::parallel_for((size_t)0, ctx.functions.size(), [&](size_t i) {
+        InputFragment *ifrag = ctx.functions[i]->ifrag;
+        std::vector<u8> &buf = ctx.compressed_bodies[i];
+        if (!compress_body(ctx, ifrag, buf))
+            return;
+
+        Debug(ctx, DEBUG_RELOC)
+            << "compressed " << ctx.functions[i]->name << ": "
+            << ifrag->get_size() << " -> " << buf.size() << " bytes";
+        ifrag->span = buf;
+        ifrag->relocs = {};
+    });
+}
+
+void InputFragment::apply_reloc(Context &ctx, u64 osec_content_file_offset) {
+    RelocTarget t{
+        .obj = obj,
+        .base = ctx.buf + osec_content_file_offset + out_offset,
+        .in_offset = in_offset,
+    };
+    apply_relocs(ctx, t, relocs);
+}
+
+void InputFragment::apply_data_reloc(Context &ctx, u8 *seg_buf, u32 seg_va) {
+    RelocTarget t{
+        .obj = obj,
+        .base = seg_buf + seg_offset,
+        .in_offset = in_offset,
+        .va = seg_va + seg_offset,
+    };
+    apply_relocs(ctx, t, relocs);
+}
+
+} // namespace xld::wasm
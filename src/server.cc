@@ -0,0 +1,392 @@
+// This file implements the link server and its client.
+//
+// A test suite may link thousands of small programs against the same
+// libraries, and every one of those links maps the libraries, indexes
+// them and parses the members it needs all over again. With
+// `xld --server <socket>`, a resident process does the links instead. It
+// keeps what it has read in a ResidentInputs, so a link only parses the
+// files which are new or have changed, and its worker threads stay up
+// between links.
+//
+// `xld --connect <socket> <args>...` is the client. It sends its working
+// directory and arguments to the server together with its stdout and
+// stderr, which the server writes to for the duration of the link, and
+// exits with the status the server sends back.
+//
+// A request is a u32 size followed by that many bytes of NUL-terminated
+// strings: the working directory and then the arguments. The two file
+// descriptors are attached to the size as SCM_RIGHTS data. The reply is
+// an i32 exit status.
+
+#include "common/file.h"
+#include "xld.h"
+#include <fcntl.h>
+#include <filesystem>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace xld::wasm {
+
+// Offset of `mf` in the file it is sliced out of
+static i64 get_offset(MappedFile *mf) {
+    MappedFile *root = mf;
+    while (root->parent)
+        root = root->parent;
+    return mf->data - root->data;
+}
+
+// Entries are keyed by absolute path, since clients may run in different
+// directories. Archive members are also keyed by their offset, as an
+// archive may contain several members of the same name.
+static std::string get_key(const std::string &name, i64 offset) {
+    std::error_code ec;
+    std::string key =
+        path_clean(std::filesystem::absolute(name, ec).string());
+    if (offset) {
+        key += ':';
+        key += std::to_string(offset);
+    }
+    return key;
+}
+
+ResidentInputs::Entry &
+ResidentInputs::get_entry(const std::string &key, i64 size, i64 mtime) {
+    std::unique_ptr<Entry> &ent = entries[key];
+    if (ent && (ent->size != size || ent->mtime != mtime))
+        replaced.push_back(std::move(ent));
+    if (!ent) {
+        ent = std::make_unique<Entry>();
+        ent->size = size;
+        ent->mtime = mtime;
+    }
+    return *ent;
+}
+
+MappedFile *ResidentInputs::open_file(Context &ctx, const std::string &path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) == -1)
+        Fatal(ctx) << "cannot open " << path << ": " << errno_string();
+
+    std::string key = get_key(path, 0);
+    MappedFile *root = nullptr;
+    {
+        std::scoped_lock lock(mu);
+        auto it = entries.find(key);
+        if (it != entries.end() && it->second->mf &&
+            it->second->size == st.st_size &&
+            it->second->mtime == get_mtime(st))
+            root = it->second->mf.get();
+    }
+
+    if (!root) {
+        std::string error;
+        MappedFile *mf = open_file_impl(path, error);
+        if (!error.empty()) {
+            delete mf;
+            Fatal(ctx) << error;
+        }
+        if (!mf)
+            Fatal(ctx) << "cannot open " << path << ": " << errno_string();
+
+        std::scoped_lock lock(mu);
+        Entry &ent = get_entry(key, mf->size, mf->mtime);
+        if (ent.mf)
+            ctx.mf_pool.push_back(std::unique_ptr<MappedFile>(mf));
+        else
+            ent.mf.reset(mf);
+        root = ent.mf.get();
+    }
+
+    // The mapping may have been made for another link, so give this one
+    // its own view, named as this link names the file.
+    return root->slice(ctx, path, 0, root->size);
+}
+
+bool ResidentInputs::load_parse_state(Context &ctx, ObjectFile &obj) {
+    std::string key = get_key(obj.filename, get_offset(obj.mf));
+    std::span<const u8> state;
+    {
+        std::scoped_lock lock(mu);
+        auto it = entries.find(key);
+        if (it != entries.end() && it->second->size == obj.mf->size &&
+            it->second->mtime == obj.mf->mtime)
+            state = it->second->parse_state;
+    }
+
+    if (state.empty() || !obj.restore_parse_state(ctx, state)) {
+        // With --cache-dir, the lookup that follows counts the miss.
+        if (ctx.arg.cache_dir.empty())
+            ctx.num_cache_misses++;
+        return false;
+    }
+    Debug(ctx, DEBUG_INPUT) << "resident hit: " << obj.filename;
+    ctx.num_cache_hits++;
+    return true;
+}
+
+void ResidentInputs::save_parse_state(ObjectFile &obj) {
+    std::string key = get_key(obj.filename, get_offset(obj.mf));
+    std::vector<u8> state = obj.save_parse_state();
+
+    std::scoped_lock lock(mu);
+    Entry &ent = get_entry(key, obj.mf->size, obj.mf->mtime);
+    if (ent.parse_state.empty())
+        ent.parse_state = std::move(state);
+}
+
+std::span<const u8> ResidentInputs::get_archive_index(MappedFile *mf) {
+    std::string key = get_key(mf->name, get_offset(mf));
+    std::scoped_lock lock(mu);
+    auto it = entries.find(key);
+    if (it == entries.end())
+        return {};
+    return it->second->archive_index;
+}
+
+void ResidentInputs::save_archive_index(MappedFile *mf,
+                                        std::span<const u8> index) {
+    std::string key = get_key(mf->name, get_offset(mf));
+    std::scoped_lock lock(mu);
+    Entry &ent = get_entry(key, mf->size, mf->mtime);
+    if (ent.archive_index.empty())
+        ent.archive_index.assign(index.begin(), index.end());
+}
+
+void ResidentInputs::release_replaced() {
+    std::scoped_lock lock(mu);
+    replaced.clear();
+}
+
+static sockaddr_un get_socket_addr(Context &ctx, const std::string &path) {
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))
+        Fatal(ctx) << "socket path is too long: " << path;
+    memcpy(addr.sun_path, path.data(), path.size());
+    return addr;
+}
+
+static bool read_all(int fd, void *buf, size_t size) {
+    u8 *p = (u8 *)buf;
+    while (size > 0) {
+        ssize_t n = read(fd, p, size);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool write_all(int fd, const void *buf, size_t size) {
+    const u8 *p = (const u8 *)buf;
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+// Receives a request and the client's stdout and stderr. Returns false
+// if the request is malformed or the client went away.
+static bool read_request(int conn, std::vector<std::string> &args,
+                         int (&fds)[2]) {
+    u32 size = 0;
+    iovec iov = {&size, sizeof(size)};
+    alignas(cmsghdr) char cbuf[CMSG_SPACE(sizeof(fds))] = {};
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    if (recvmsg(conn, &msg, 0) != sizeof(size))
+        return false;
+
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+        cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(sizeof(fds)))
+        return false;
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+    std::string buf(size, '\0');
+    if (!read_all(conn, buf.data(), size) || buf.empty() ||
+        buf.back() != '\0') {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+
+    for (size_t pos = 0; pos < buf.size();) {
+        size_t end = buf.find('\0', pos);
+        args.push_back(buf.substr(pos, end - pos));
+        pos = end + 1;
+    }
+    return true;
+}
+
+// Runs a link for a client, in the client's working directory and with
+// the client's stdout and stderr.
+static i32 serve_request(Context &ctx, ResidentInputs &resident,
+                         std::vector<std::string> &args, int (&fds)[2]) {
+    std::cout.flush();
+    std::cerr.flush();
+    int saved_stdout = dup(STDOUT_FILENO);
+    int saved_stderr = dup(STDERR_FILENO);
+    int saved_cwd = open(".", O_RDONLY);
+    dup2(fds[0], STDOUT_FILENO);
+    dup2(fds[1], STDERR_FILENO);
+    close(fds[0]);
+    close(fds[1]);
+
+    i32 status = 1;
+    if (chdir(args[0].c_str()) == -1) {
+        Error(ctx) << "cannot change directory to " << args[0] << ": "
+                   << errno_string();
+    } else {
+        std::vector<char *> argv = {(char *)"xld"};
+        for (size_t i = 1; i < args.size(); i++)
+            argv.push_back(args[i].data());
+        argv.push_back(nullptr);
+
+        try {
+            status = linker_main(argv.size() - 1, argv.data(), &resident);
+        } catch (FatalError &) {
+            status = 1;
+        } catch (std::exception &e) {
+            // Report to the client and keep serving the others.
+            report(ctx, "error", true,
+                   std::string("link failed: ") + e.what());
+            status = 1;
+        }
+    }
+
+    std::cout.flush();
+    std::cerr.flush();
+    if (fchdir(saved_cwd) == -1)
+        Fatal(ctx) << "cannot restore the working directory: "
+                   << errno_string();
+    dup2(saved_stdout, STDOUT_FILENO);
+    dup2(saved_stderr, STDERR_FILENO);
+    close(saved_stdout);
+    close(saved_stderr);
+    close(saved_cwd);
+
+    resident.release_replaced();
+    return status;
+}
+
+int run_server(Context &ctx) {
+    const std::string &path = ctx.arg.server;
+    sockaddr_un addr = get_socket_addr(ctx, path);
+
+    // Replace the socket of a server which has exited, but nothing else.
+    // A socket nobody listens on refuses connections.
+    struct stat st;
+    if (lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (probe == -1)
+            Fatal(ctx) << "socket failed: " << errno_string();
+        if (connect(probe, (sockaddr *)&addr, sizeof(addr)) == 0)
+            Fatal(ctx) << path << ": server already running";
+        if (errno != ECONNREFUSED)
+            Fatal(ctx) << "cannot connect to " << path << ": "
+                       << errno_string();
+        close(probe);
+        unlink(path.c_str());
+    }
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock == -1)
+        Fatal(ctx) << "socket failed: " << errno_string();
+    if (bind(sock, (sockaddr *)&addr, sizeof(addr)) == -1)
+        Fatal(ctx) << "cannot bind " << path << ": " << errno_string();
+    if (listen(sock, SOMAXCONN) == -1)
+        Fatal(ctx) << "listen failed: " << errno_string();
+
+    if (ctx.arg.verbose)
+        SyncOut(ctx) << "Listening on " << path;
+
+    // A client which goes away while its link is writing to it must not
+    // end the server.
+    signal(SIGPIPE, SIG_IGN);
+
+    ResidentInputs resident;
+    for (;;) {
+        int conn = accept(sock, nullptr, nullptr);
+        if (conn == -1) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            Fatal(ctx) << "accept failed: " << errno_string();
+        }
+
+        std::vector<std::string> args;
+        int fds[2];
+        if (read_request(conn, args, fds)) {
+            i32 status = serve_request(ctx, resident, args, fds);
+            write_all(conn, &status, sizeof(status));
+        }
+        close(conn);
+    }
+}
+
+int run_client(Context &ctx, int argc, char **argv) {
+    const std::string &path = ctx.arg.connect;
+    sockaddr_un addr = get_socket_addr(ctx, path);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock == -1)
+        Fatal(ctx) << "socket failed: " << errno_string();
+    if (connect(sock, (sockaddr *)&addr, sizeof(addr)) == -1)
+        Fatal(ctx) << "cannot connect to " << path << ": " << errno_string();
+
+    std::error_code ec;
+    std::string buf = std::filesystem::current_path(ec).string();
+    if (ec)
+        Fatal(ctx) << "cannot get the working directory: " << ec.message();
+    buf += '\0';
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (arg == "--connect")
+            i++;
+        else if (!arg.starts_with("--connect="))
+            buf += std::string(arg) + '\0';
+    }
+
+    u32 size = buf.size();
+    int fds[] = {STDOUT_FILENO, STDERR_FILENO};
+    iovec iov = {&size, sizeof(size)};
+    alignas(cmsghdr) char cbuf[CMSG_SPACE(sizeof(fds))] = {};
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    if (sendmsg(sock, &msg, 0) != sizeof(size) ||
+        !write_all(sock, buf.data(), buf.size()))
+        Fatal(ctx) << "cannot send to " << path << ": " << errno_string();
+
+    i32 status;
+    if (!read_all(sock, &status, sizeof(status)))
+        Fatal(ctx) << "lost connection to " << path;
+    close(sock);
+    return status;
+}
+
+} // namespace xld::wasm
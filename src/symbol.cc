@@ -19,13 +19,15 @@ u32 get_rank(const WasmSymbol &wsym) {
 // If we haven't seen the same `name` before, create a new instance
 // of Symbol and returns it. Otherwise, returns the previously-
 // instantiated object.
+//
+// `hash` must be hash_string(name). Callers which look up the same name
+// more than once should compute it once and pass it in.
+Symbol *get_symbol(Context &ctx, std::string_view name, u64 hash) {
+    return ctx.symbol_map.insert(name, hash, name, nullptr).first;
+}
+
 Symbol *get_symbol(Context &ctx, std::string_view name) {
-    typename decltype(ctx.symbol_map)::const_accessor acc;
-    // https://stackoverflow.com/questions/27960325/stdmap-emplace-without-copying-value
-    ctx.symbol_map.emplace(acc, std::piecewise_construct,
-                           std::forward_as_tuple(name),
-                           std::forward_as_tuple(name, nullptr));
-    return const_cast<Symbol *>(&acc->second);
+    return get_symbol(ctx, name, hash_string(name));
 }
 
 bool should_export_symbol(Context &ctx, Symbol *sym) {
@@ -0,0 +1,48 @@
+#!/bin/bash
+. $(dirname $0)/common.inc
+
+cat <<EOF | $CC --target=wasm32 -xc -c -o $t/a.o -
+int baz();
+
+int foo() {
+    return baz();
+}
+EOF
+
+cat <<EOF | $CC --target=wasm32 -xc -c -o $t/b.o -
+int baz() {
+    return 42;
+}
+EOF
+
+# Not needed by main, so it must not be extracted. Otherwise the
+# reference to `missing` would be an undefined symbol error.
+cat <<EOF | $CC --target=wasm32 -xc -c -o $t/c.o -
+int missing();
+
+int bar() {
+    return missing();
+}
+EOF
+
+cat <<EOF | $CC --target=wasm32 -xc -c -o $t/d.o -
+int foo();
+
+int main() {
+    return foo();
+}
+EOF
+
+rm -f $t/libfoo.a $t/libfoo-nosym.a $t/libfoo-thin.a
+$AR rc $t/libfoo.a $t/c.o $t/a.o $t/b.o
+$AR rcS $t/libfoo-nosym.a $t/c.o $t/a.o $t/b.o
+$AR rcT $t/libfoo-thin.a $t/c.o $t/a.o $t/b.o
+
+$XLD $t/d.o $t/libfoo.a --export-all -o $t/a.wasm
+node main.js $t/a.wasm | grep -q "42" || { echo "Unexpected output"; exit 1; }
+
+$XLD $t/d.o $t/libfoo-nosym.a --export-all -o $t/b.wasm
+node main.js $t/b.wasm | grep -q "42" || { echo "Unexpected output"; exit 1; }
+
+$XLD $t/d.o $t/libfoo-thin.a --export-all -o $t/c.wasm
+node main.js $t/c.wasm | grep -q "42" || { echo "Unexpected output"; exit 1; }
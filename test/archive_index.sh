@@ -0,0 +1,55 @@
+#!/bin/bash
+. $(dirname $0)/common.inc
+
+cat <<EOF | $CC --target=wasm32 -xc -c -o $t/a.o -
+int baz();
+
+int foo() {
+    return baz();
+}
+EOF
+
+cat <<EOF | $CC --target=wasm32 -xc -c -o $t/b.o -
+int baz() {
+    return 42;
+}
+EOF
+
+cat <<EOF | $CC --target=wasm32 -xc -c -o $t/c.o -
+int missing();
+
+int bar() {
+    return missing();
+}
+EOF
+
+cat <<EOF | $CC --target=wasm32 -xc -c -o $t/d.o -
+int foo();
+
+int main() {
+    return foo();
+}
+EOF
+
+rm -f $t/libfoo.a $t/libfoo.a.xldidx
+$AR rc $t/libfoo.a $t/c.o $t/a.o $t/b.o
+
+$XLD $t/d.o $t/libfoo.a --export-all -o $t/a.wasm
+node main.js $t/a.wasm | grep -q "42" || { echo "Unexpected output"; exit 1; }
+
+$XLD --index-archive $t/libfoo.a
+[ -f $t/libfoo.a.xldidx ] || { echo "Index not written"; exit 1; }
+
+$XLD $t/d.o $t/libfoo.a --export-all -o $t/b.wasm
+node main.js $t/b.wasm | grep -q "42" || { echo "Unexpected output"; exit 1; }
+cmp $t/a.wasm $t/b.wasm || { echo "Output differs with an index"; exit 1; }
+
+# An index is ignored once its archive changes. The members move, so
+# using the old index would read the wrong ones.
+rm $t/libfoo.a
+$AR rc $t/libfoo.a $t/b.o $t/a.o $t/c.o
+$XLD $t/d.o $t/libfoo.a --export-all -o $t/c.wasm
+node main.js $t/c.wasm | grep -q "42" || { echo "Unexpected output"; exit 1; }
+mv $t/libfoo.a.xldidx $t/libfoo.a.xldidx.old
+$XLD $t/d.o $t/libfoo.a --export-all -o $t/d.wasm
+cmp $t/c.wasm $t/d.wasm || { echo "Output differs with a stale index"; exit 1; }
@@ -0,0 +1,53 @@
+#!/bin/bash
+. $(dirname $0)/common.inc
+
+cat <<EOF | $CC --target=wasm32 -xc -c -o $t/a.o -
+int foo() {
+    return 41;
+}
+EOF
+
+cat <<EOF | $CC --target=wasm32 -xc -c -o $t/b.o -
+int foo();
+
+int main() {
+    return foo() + 1;
+}
+EOF
+
+cat <<EOF | $CC --target=wasm32 -xc -c -o $t/c.o -
+int foo();
+
+int main() {
+    return foo() + 1;
+}
+
+int bar() {
+    return 0;
+}
+EOF
+
+rm -f $t/libfoo-batch.a
+$AR rc $t/libfoo-batch.a $t/a.o
+
+$XLD $t/b.o $t/libfoo-batch.a --export-all -o $t/a.wasm
+
+cat <<EOF > $t/jobs.txt
+# Both links share the archive.
+$t/b.o $t/libfoo-batch.a --export-all -o $t/b.wasm
+$t/c.o $t/libfoo-batch.a --export-all -o $t/c.wasm
+EOF
+
+$XLD --batch $t/jobs.txt
+cmp -s $t/a.wasm $t/b.wasm || { echo "Output differs in a batch"; exit 1; }
+node main.js $t/b.wasm | grep -q "42" || { echo "Unexpected output"; exit 1; }
+node main.js $t/c.wasm | grep -q "42" || { echo "Unexpected output"; exit 1; }
+
+# A failed link fails the batch, but the other links are still done.
+rm -f $t/b.wasm
+cat <<EOF > $t/jobs.txt
+$t/b.o --export-all -o $t/d.wasm
+$t/b.o $t/libfoo-batch.a --export-all -o $t/b.wasm
+EOF
+$XLD --batch $t/jobs.txt && { echo "Batch must fail"; exit 1; }
+node main.js $t/b.wasm | grep -q "42" || { echo "Unexpected output"; exit 1; }
@@ -0,0 +1,57 @@
+#!/bin/bash
+. $(dirname $0)/common.inc
+
+cat <<EOF | $CC --target=wasm32 -xc -c -o $t/a.o -
+int value = 40;
+
+int foo() {
+    return value + 1;
+}
+EOF
+
+cat <<EOF | $CC --target=wasm32 -xc -c -o $t/b.o -
+int foo();
+
+int main() {
+    return foo() + 1;
+}
+EOF
+
+rm -rf $t/cache $t/cache2 $t/libfoo-cache.a
+$AR rc $t/libfoo-cache.a $t/a.o
+
+$XLD $t/b.o $t/libfoo-cache.a --export-all -o $t/a.wasm
+
+# The first link fills the cache and the second one reads from it. Both
+# must produce the same output as a link without the cache.
+$XLD $t/b.o $t/libfoo-cache.a --export-all --cache-dir $t/cache -o $t/b.wasm
+ls $t/cache/*.cache > /dev/null 2>&1 || { echo "Cache is empty"; exit 1; }
+$XLD $t/b.o $t/libfoo-cache.a --export-all --cache-dir $t/cache -o $t/c.wasm
+
+cmp -s $t/a.wasm $t/b.wasm ||
+    { echo "Output differs when filling the cache"; exit 1; }
+cmp -s $t/a.wasm $t/c.wasm ||
+    { echo "Output differs when reading the cache"; exit 1; }
+
+# Cache files depend only on their inputs.
+$XLD $t/b.o $t/libfoo-cache.a --export-all --cache-dir $t/cache2 -o $t/d.wasm
+diff -r $t/cache $t/cache2 > /dev/null ||
+    { echo "Cache files differ between runs"; exit 1; }
+
+node main.js $t/c.wasm | grep -q "42" || { echo "Unexpected output"; exit 1; }
+
+# A changed input misses the cache.
+cat <<EOF | $CC --target=wasm32 -xc -c -o $t/a.o -
+int value = 41;
+
+int foo() {
+    return value + 1;
+}
+EOF
+rm -f $t/libfoo-cache.a
+$AR rc $t/libfoo-cache.a $t/a.o
+$XLD $t/b.o $t/libfoo-cache.a --export-all -o $t/e.wasm
+$XLD $t/b.o $t/libfoo-cache.a --export-all --cache-dir $t/cache -o $t/f.wasm
+cmp -s $t/e.wasm $t/f.wasm ||
+    { echo "Output differs after an input changed"; exit 1; }
+node main.js $t/f.wasm | grep -q "43" || { echo "Unexpected output"; exit 1; }
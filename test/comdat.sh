@@ -0,0 +1,33 @@
+#!/bin/bash
+. $(dirname $0)/common.inc
+
+cat <<EOF | $CC --target=wasm32 -xc++ -c -o $t/a.o -
+inline int get() {
+    static int x = 21;
+    return x;
+}
+
+int use_a() {
+    return get();
+}
+EOF
+
+cat <<EOF | $CC --target=wasm32 -xc++ -c -o $t/b.o -
+inline int get() {
+    static int x = 21;
+    return x;
+}
+
+int use_a();
+
+int main() {
+    return use_a() + get();
+}
+EOF
+
+$XLD $t/a.o $t/b.o --export-all -o $t/a.wasm
+
+[ "$($OBJDUMP -x $t/a.wasm | grep -c "sig=.*<_Z3getv>")" == 1 ] ||
+    { echo "COMDAT group is not deduplicated"; exit 1; }
+
+node main.js $t/a.wasm | grep -q "42" || { echo "Unexpected output"; exit 1; }
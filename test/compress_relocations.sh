@@ -0,0 +1,22 @@
+#!/bin/bash
+. $(dirname $0)/common.inc
+
+cat <<EOF | $CC --target=wasm32 -xc -c -o $t/a.o -
+int x = 20;
+
+int add(int a, int b) {
+    return a + b;
+}
+
+int main() {
+    return add(add(x, 1), add(x, 1));
+}
+EOF
+
+$XLD $t/a.o --export-all -o $t/a.wasm
+$XLD $t/a.o --export-all --compress-relocations -o $t/b.wasm
+
+[ "$(stat -c %s $t/b.wasm)" -lt "$(stat -c %s $t/a.wasm)" ] ||
+    { echo "Relocations are not compressed"; exit 1; }
+
+node main.js $t/b.wasm | grep -q "42" || { echo "Unexpected output"; exit 1; }
@@ -0,0 +1,27 @@
+#!/bin/bash
+. $(dirname $0)/common.inc
+
+cat <<EOF | $CC --target=wasm32 -xc++ -c -o $t/a.o -
+struct Base {
+    virtual int get() { return 1; }
+};
+
+struct Derived : Base {
+    int get() override { return 40; }
+};
+
+int one = 1;
+int *ptrs[] = {&one, &one};
+const char *strs[] = {"a", "bc"};
+
+Derived d;
+Base *b = &d;
+
+int main() {
+    return b->get() + *ptrs[0] + (strs[1][1] == 'c');
+}
+EOF
+
+$XLD $t/a.o --export-all -o $t/a.wasm
+
+node main.js $t/a.wasm | grep -q "42" || { echo "Unexpected output"; exit 1; }
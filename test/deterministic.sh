@@ -0,0 +1,39 @@
+#!/bin/bash
+. $(dirname $0)/common.inc
+
+for i in $(seq 0 15); do
+    cat <<EOF | $CC --target=wasm32 -xc -c -o $t/a$i.o -
+int data$i = $i;
+int next$((i + 1))();
+
+int get$i() {
+    return data$i;
+}
+
+int next$i() {
+    return get$i() + next$((i + 1))();
+}
+EOF
+done
+
+cat <<EOF | $CC --target=wasm32 -xc -c -o $t/main.o -
+int next0();
+
+int next16() {
+    return 0;
+}
+
+int main() {
+    return next0() - 78;
+}
+EOF
+
+$XLD $t/main.o $t/a*.o --export-all --threads=1 -o $t/a.wasm
+$XLD $t/main.o $t/a*.o --export-all --threads=8 -o $t/b.wasm
+$XLD $t/main.o $t/a*.o --export-all --threads=8 -o $t/c.wasm
+
+cmp -s $t/a.wasm $t/b.wasm ||
+    { echo "Output differs between 1 and 8 threads"; exit 1; }
+cmp -s $t/b.wasm $t/c.wasm || { echo "Output differs between runs"; exit 1; }
+
+node main.js $t/a.wasm | grep -q "42" || { echo "Unexpected output"; exit 1; }
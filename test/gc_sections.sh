@@ -0,0 +1,28 @@
+#!/bin/bash
+. $(dirname $0)/common.inc
+
+cat <<EOF | $CC --target=wasm32 -xc -c -o $t/a.o -
+int used_data = 40;
+int unused_data = 1;
+
+int unused_func() {
+    return unused_data;
+}
+
+int helper() {
+    return 2;
+}
+
+int main() {
+    return helper() + used_data;
+}
+EOF
+
+$XLD $t/a.o --export=main --gc-sections --print-gc-sections -o $t/a.wasm > $t/log
+
+grep -q "unused_func" $t/log || { echo "unused_func is not removed"; exit 1; }
+grep -q "unused_data" $t/log || { echo "unused_data is not removed"; exit 1; }
+grep -q "helper" $t/log && { echo "helper is removed"; exit 1; }
+grep -q "(.data.used_data)" $t/log && { echo "used_data is removed"; exit 1; }
+
+node main.js $t/a.wasm | grep -q "42" || { echo "Unexpected output"; exit 1; }
@@ -0,0 +1,54 @@
+#!/bin/bash
+. $(dirname $0)/common.inc
+
+cat <<EOF | $CC --target=wasm32 -xc -c -o $t/a.o -
+int foo(int x) {
+    return x * 3 + 1;
+}
+
+int bar(int x) {
+    return x * 3 + 1;
+}
+
+int main() {
+    return foo(10) + bar(3) + 1;
+}
+EOF
+
+$XLD $t/a.o --export-all -o $t/a.wasm
+$OBJDUMP -d $t/a.wasm | grep -q "<bar>:" ||
+    { echo "bar is missing without --icf"; exit 1; }
+
+$XLD $t/a.o --export-all --icf=all -o $t/b.wasm
+$OBJDUMP -d $t/b.wasm | grep -q "<bar>:" &&
+    { echo "bar is not folded"; exit 1; }
+
+node main.js $t/b.wasm | grep -q "42" || { echo "Unexpected output"; exit 1; }
+
+# A weak definition that lost to a strong one is not emitted, so it must
+# not lead a fold class.
+cat <<EOF | $CC --target=wasm32 -xc -c -o $t/c.o -
+__attribute__((weak)) int foo() {
+    return 7;
+}
+
+int bar();
+
+int main() {
+    return foo() + bar();
+}
+EOF
+
+cat <<EOF | $CC --target=wasm32 -xc -c -o $t/d.o -
+int foo() {
+    return 7;
+}
+
+int bar() {
+    return 7;
+}
+EOF
+
+$XLD $t/c.o $t/d.o --export-all --icf=all -o $t/c.wasm ||
+    { echo "Link failed"; exit 1; }
+node main.js $t/c.wasm | grep -q "14" || { echo "Unexpected output"; exit 1; }
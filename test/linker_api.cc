@@ -0,0 +1,80 @@
+// Test driver of the Linker API in include/linker.h.
+//
+// Reads the given object files into memory and links them through
+// Linker, so that no input is read from disk by the linker. It checks
+// that link() and link(sink) produce the same output, and that a link
+// with an undefined symbol fails with diagnostics instead of exiting the
+// process. The output of the successful link is written to the given
+// file.
+//
+// Usage: linker_api <output> <object files...>
+
+#include "linker.h"
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+using namespace xld;
+using namespace xld::wasm;
+
+static std::vector<u8> read_file(const char *path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        std::cerr << "cannot open " << path << "\n";
+        exit(1);
+    }
+    return {std::istreambuf_iterator<char>(in),
+            std::istreambuf_iterator<char>()};
+}
+
+static void check(bool cond, const char *msg) {
+    if (!cond) {
+        std::cerr << "linker_api: " << msg << "\n";
+        exit(1);
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        std::cerr << "usage: linker_api <output> <object files...>\n";
+        return 1;
+    }
+
+    std::vector<std::vector<u8>> bufs;
+    for (int i = 2; i < argc; i++)
+        bufs.push_back(read_file(argv[i]));
+
+    Linker linker({"--export-all"});
+    for (int i = 2; i < argc; i++)
+        linker.add_input(argv[i], bufs[i - 2]);
+
+    // Link into a buffer owned by the result
+    LinkResult a = linker.link();
+    check(a.ok, "link() failed");
+    check(!a.output.empty(), "link() returned no output");
+
+    // Link into a buffer owned by the caller
+    std::vector<u8> out;
+    LinkResult b = linker.link([&](u64 size) {
+        out.resize(size);
+        return out.data();
+    });
+    check(b.ok, "link(sink) failed");
+    check(b.output.empty(), "link(sink) returned an output buffer");
+    check(out == a.output, "link() and link(sink) differ");
+
+    // Only the last input, which leaves symbols of the others undefined
+    Linker failing({"--export-all"});
+    failing.add_input(argv[argc - 1], bufs.back());
+    LinkResult c = failing.link();
+    check(!c.ok, "link with an undefined symbol succeeded");
+    check(c.output.empty(), "failed link returned an output");
+    bool has_error = false;
+    for (LinkerDiagnostic &diag : c.diagnostics)
+        has_error |= diag.is_error;
+    check(has_error, "failed link returned no error");
+
+    std::ofstream(argv[1], std::ios::binary)
+        .write((const char *)a.output.data(), a.output.size());
+    return 0;
+}
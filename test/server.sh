@@ -0,0 +1,66 @@
+#!/bin/bash
+. $(dirname $0)/common.inc
+
+cat <<EOF | $CC --target=wasm32 -xc -c -o $t/a.o -
+int foo() {
+    return 41;
+}
+EOF
+
+cat <<EOF | $CC --target=wasm32 -xc -c -o $t/b.o -
+int foo();
+
+int main() {
+    return foo() + 1;
+}
+EOF
+
+sock=$t/server.sock
+rm -f $t/libfoo-server.a $sock
+$AR rc $t/libfoo-server.a $t/a.o
+
+$XLD $t/b.o $t/libfoo-server.a --export-all -o $t/a.wasm
+
+$XLD --server $sock &
+server=$!
+trap "kill $server" EXIT
+for i in $(seq 50); do
+    [ -S $sock ] && break
+    sleep 0.1
+done
+
+# The first link parses the inputs and the second one reuses them. Both
+# must produce the same output as a link without the server.
+$XLD --connect $sock $t/b.o $t/libfoo-server.a --export-all -o $t/b.wasm
+$XLD --connect $sock $t/b.o $t/libfoo-server.a --export-all -o $t/c.wasm
+cmp -s $t/a.wasm $t/b.wasm ||
+    { echo "Output differs on the first link"; exit 1; }
+cmp -s $t/a.wasm $t/c.wasm ||
+    { echo "Output differs on the second link"; exit 1; }
+node main.js $t/c.wasm | grep -q "42" || { echo "Unexpected output"; exit 1; }
+
+# A failed link is reported to the client and does not stop the server.
+$XLD --connect $sock $t/b.o --export-all -o $t/d.wasm &&
+    { echo "Link must fail"; exit 1; }
+$XLD --connect $sock $t/b.o $t/libfoo-server.a --export-all -o $t/d.wasm
+node main.js $t/d.wasm | grep -q "42" || { echo "Unexpected output"; exit 1; }
+
+# A second server must not take over the socket of a running one.
+$XLD --server $sock && { echo "Second server must fail"; exit 1; }
+$XLD --connect $sock $t/b.o $t/libfoo-server.a --export-all -o $t/e.wasm
+cmp -s $t/a.wasm $t/e.wasm ||
+    { echo "Output differs after a second server"; exit 1; }
+
+# Inputs which change between links are parsed again.
+cat <<EOF | $CC --target=wasm32 -xc -c -o $t/a.o -
+int foo() {
+    return 42;
+}
+EOF
+rm -f $t/libfoo-server.a
+$AR rc $t/libfoo-server.a $t/a.o
+$XLD $t/b.o $t/libfoo-server.a --export-all -o $t/f.wasm
+$XLD --connect $sock $t/b.o $t/libfoo-server.a --export-all -o $t/g.wasm
+cmp -s $t/f.wasm $t/g.wasm ||
+    { echo "Output differs after an input changed"; exit 1; }
+node main.js $t/g.wasm | grep -q "43" || { echo "Unexpected output"; exit 1; }
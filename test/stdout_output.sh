@@ -0,0 +1,22 @@
+#!/bin/bash
+. $(dirname $0)/common.inc
+
+cat <<EOF | $CC --target=wasm32 -xc -c -o $t/a.o -
+int foo() {
+    return 41;
+}
+EOF
+
+cat <<EOF | $CC --target=wasm32 -xc -c -o $t/b.o -
+int foo();
+
+int main() {
+    return foo() + 1;
+}
+EOF
+
+$XLD $t/a.o $t/b.o --export-all -o $t/a.wasm
+$XLD $t/a.o $t/b.o --export-all -o - > $t/b.wasm
+
+cmp -s $t/a.wasm $t/b.wasm || { echo "Output differs"; exit 1; }
+node main.js $t/b.wasm | grep -q "42" || { echo "Unexpected output"; exit 1; }
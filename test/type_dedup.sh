@@ -0,0 +1,25 @@
+#!/bin/bash
+. $(dirname $0)/common.inc
+
+cat <<EOF | $CC --target=wasm32 -xc -c -o $t/a.o -
+int foo(int x) { return x + 1; }
+int bar(int x) { return x + 2; }
+EOF
+
+cat <<EOF | $CC --target=wasm32 -xc -c -o $t/b.o -
+int foo(int x);
+int bar(int x);
+int baz(int x) { return x + 3; }
+
+int main() {
+    return foo(10) + bar(10) + baz(10) + 3;
+}
+EOF
+
+$XLD $t/a.o $t/b.o --export-all -o $t/a.wasm
+
+# (i32) -> i32, () -> i32 and () -> nil for __wasm_call_ctors
+$OBJDUMP -h $t/a.wasm | grep -q "Type .* count: 3" ||
+    { echo "Types are not deduplicated"; exit 1; }
+
+node main.js $t/a.wasm | grep -q "42" || { echo "Unexpected output"; exit 1; }